@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "bcast_ring.h"
+
+#define asm_pause() asm volatile("pause")
+#define SPIN_TRIES 128  // number of failed checks before going to sleep
+
+bcast_ring_t *bcast_ring_create(size_t capacity, size_t entry_size, int nb_consumers)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    // Round the entries to cache lines so that two entries never share one
+    entry_size = (entry_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+
+    bcast_ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(*ring));
+    ring->mask = size - 1;
+    ring->max_lag = size;
+    ring->lag_policy = BCAST_BLOCK;
+    ring->entry_size = entry_size;
+    ring->entries = aligned_alloc(CACHE_LINE_SIZE, size * entry_size);
+    ring->nb_consumers = nb_consumers;
+    ring->cursors = aligned_alloc(CACHE_LINE_SIZE, nb_consumers * sizeof(bcast_cursor_t));
+
+    for (int i = 0; i < nb_consumers; i ++)
+    {
+        atomic_init(&ring->cursors[i].pos, 0);
+        ring->cursors[i].snap = 0;
+        atomic_init(&ring->cursors[i].dropped, 0);
+        atomic_init(&ring->cursors[i].skipped, 0);
+    }
+
+    atomic_init(&ring->published, 0);
+    ring->claimed = 0;
+    ring->min_cursor = 0;
+    atomic_init(&ring->producer_waiting, 0);
+    atomic_init(&ring->nb_waiting_consumers, 0);
+    atomic_init(&ring->closed, 0);
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+
+    return ring;
+}
+
+void bcast_ring_destroy(bcast_ring_t *ring)
+{
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->not_full);
+    pthread_cond_destroy(&ring->not_empty);
+    free(ring->cursors);
+    free(ring->entries);
+    free(ring);
+}
+
+void bcast_ring_set_lag_policy(bcast_ring_t *ring, size_t max_lag, int policy)
+{
+    ring->max_lag = max_lag < 1 ? 1 : max_lag > ring->mask + 1 ? ring->mask + 1 : max_lag;
+    ring->lag_policy = policy;
+}
+
+// Dropped consumers do not hold the producer back anymore
+static size_t slowest_cursor(bcast_ring_t *ring, size_t pos)
+{
+    size_t min = pos;
+    for (int i = 0; i < ring->nb_consumers; i ++)
+    {
+        if (atomic_load_explicit(&ring->cursors[i].dropped, memory_order_relaxed))
+        {
+            continue;
+        }
+        size_t cur = atomic_load_explicit(&ring->cursors[i].pos, memory_order_acquire);
+        if (cur < min)
+        {
+            min = cur;
+        }
+    }
+    return min;
+}
+
+// The producer only scans the cursors when its cached minimum says the ring is full
+static int is_full(bcast_ring_t *ring, size_t pos)
+{
+    if (pos - ring->min_cursor < ring->max_lag)
+    {
+        return 0;
+    }
+    ring->min_cursor = slowest_cursor(ring, pos);
+    return pos - ring->min_cursor >= ring->max_lag;
+}
+
+// Drop the consumers that are max_lag entries behind pos, everything claimed
+// being published, but only while another consumer keeps up: when they all
+// lag, the producer waits for them instead
+static void drop_laggards(bcast_ring_t *ring, size_t pos)
+{
+    int nb_kept = 0;
+    for (int i = 0; i < ring->nb_consumers; i ++)
+    {
+        bcast_cursor_t *cursor = &ring->cursors[i];
+        nb_kept += !atomic_load_explicit(&cursor->dropped, memory_order_relaxed) &&
+                   pos - atomic_load(&cursor->pos) < ring->max_lag;
+    }
+
+    for (int i = 0; i < ring->nb_consumers && nb_kept > 0; i ++)
+    {
+        bcast_cursor_t *cursor = &ring->cursors[i];
+        size_t cur = atomic_load(&cursor->pos);
+        if (atomic_load_explicit(&cursor->dropped, memory_order_relaxed) || pos - cur < ring->max_lag)
+        {
+            continue;
+        }
+        atomic_store(&cursor->dropped, 1);
+        atomic_fetch_add(&cursor->skipped, pos - cur);
+    }
+}
+
+// Move the consumers that are max_lag entries behind pos to the head, but
+// never the leader: the most advanced of the consumers that lost the fewest
+// entries. The producer waits for the leader when it lags, so at least one
+// consumer reads every entry, and a skipped consumer cannot become the leader
+// by being moved, only by losing less than the others
+static void skip_laggards(bcast_ring_t *ring, size_t pos)
+{
+    size_t lead = 0, least = SIZE_MAX;
+    for (int i = 0; i < ring->nb_consumers; i ++)
+    {
+        size_t cur = atomic_load(&ring->cursors[i].pos);
+        size_t skipped = atomic_load_explicit(&ring->cursors[i].skipped, memory_order_relaxed);
+        if (skipped < least || (skipped == least && cur > lead))
+        {
+            least = skipped;
+            lead = cur;
+        }
+    }
+    if (pos - lead >= ring->max_lag)
+    {
+        return;
+    }
+
+    for (int i = 0; i < ring->nb_consumers; i ++)
+    {
+        bcast_cursor_t *cursor = &ring->cursors[i];
+        size_t cur = atomic_load(&cursor->pos);
+        if (pos - cur < ring->max_lag)
+        {
+            continue;
+        }
+
+        // Counted before the move, so that a consumer that sees its cursor
+        // moved (see bcast_ring_release_batch) always finds them counted
+        size_t lost = pos - cur;
+        atomic_fetch_add(&cursor->skipped, lost);
+        if (!atomic_compare_exchange_strong(&cursor->pos, &cur, pos))
+        {
+            // The consumer released meanwhile: it is not late anymore
+            atomic_fetch_sub(&cursor->skipped, lost);
+        }
+    }
+}
+
+// The stores to the cursors come before the producer overwrites anything, so
+// a consumer that copied an entry and still sees its cursor unchanged read it
+// entirely (see bcast_ring_copy)
+static void cut_laggards(bcast_ring_t *ring, size_t pos)
+{
+    if (ring->lag_policy == BCAST_DROP)
+    {
+        drop_laggards(ring, pos);
+    }
+    else
+    {
+        skip_laggards(ring, pos);
+    }
+}
+
+void *bcast_ring_claim(bcast_ring_t *ring)
+{
+    size_t pos = ring->claimed;
+
+    for (int i = 0; is_full(ring, pos); i ++)
+    {
+        // The consumers can only free what is published: never wait on them
+        // while holding claimed entries
+        if (atomic_load_explicit(&ring->published, memory_order_relaxed) != pos)
+        {
+            bcast_ring_publish(ring);
+        }
+
+        if (ring->lag_policy != BCAST_BLOCK)
+        {
+            cut_laggards(ring, pos);
+            ring->min_cursor = slowest_cursor(ring, pos);
+            if (!is_full(ring, pos))
+            {
+                break;
+            }
+        }
+
+        if (i < SPIN_TRIES)
+        {
+            asm_pause();
+            continue;
+        }
+
+        // Slow path: sleep until the slowest consumer releases an entry
+        // The fence pairs with the one in bcast_ring_release_batch
+        pthread_mutex_lock(&ring->mutex);
+        atomic_store(&ring->producer_waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (is_full(ring, pos))
+        {
+            pthread_cond_wait(&ring->not_full, &ring->mutex);
+        }
+        atomic_store(&ring->producer_waiting, 0);
+        pthread_mutex_unlock(&ring->mutex);
+        break;
+    }
+
+    ring->claimed = pos + 1;
+    return ring->entries + (pos & ring->mask) * ring->entry_size;
+}
+
+void bcast_ring_publish(bcast_ring_t *ring)
+{
+    atomic_store_explicit(&ring->published, ring->claimed, memory_order_release);
+
+    // Wake the consumers only if some of them are sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->nb_waiting_consumers, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_broadcast(&ring->not_empty);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+size_t bcast_ring_available(bcast_ring_t *ring, int consumer)
+{
+    bcast_cursor_t *cursor = &ring->cursors[consumer];
+    if (atomic_load_explicit(&cursor->dropped, memory_order_relaxed))
+    {
+        return 0;
+    }
+    cursor->snap = atomic_load_explicit(&cursor->pos, memory_order_acquire);
+    return atomic_load_explicit(&ring->published, memory_order_acquire) - cursor->snap;
+}
+
+size_t bcast_ring_lag(bcast_ring_t *ring, int consumer)
+{
+    size_t pos = atomic_load_explicit(&ring->cursors[consumer].pos, memory_order_relaxed);
+    return atomic_load_explicit(&ring->published, memory_order_relaxed) - pos;
+}
+
+size_t bcast_ring_skipped(bcast_ring_t *ring, int consumer)
+{
+    return atomic_load_explicit(&ring->cursors[consumer].skipped, memory_order_relaxed);
+}
+
+bool bcast_ring_dropped(bcast_ring_t *ring, int consumer)
+{
+    return atomic_load_explicit(&ring->cursors[consumer].dropped, memory_order_relaxed);
+}
+
+void bcast_ring_close(bcast_ring_t *ring)
+{
+    bcast_ring_publish(ring);
+    atomic_store(&ring->closed, 1);
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_broadcast(&ring->not_empty);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+size_t bcast_ring_wait(bcast_ring_t *ring, int consumer)
+{
+    bcast_cursor_t *cursor = &ring->cursors[consumer];
+    size_t pos = atomic_load_explicit(&cursor->pos, memory_order_acquire);
+    size_t published;
+
+    cursor->snap = pos;
+    for (int i = 0; (published = atomic_load_explicit(&ring->published, memory_order_acquire)) <= pos; i ++)
+    {
+        // closed is set after the last publication: nothing more will come
+        if (atomic_load(&ring->closed))
+        {
+            break;
+        }
+
+        if (i < SPIN_TRIES)
+        {
+            asm_pause();
+            continue;
+        }
+
+        // Slow path: sleep until the producer publishes a new entry
+        pthread_mutex_lock(&ring->mutex);
+        atomic_fetch_add(&ring->nb_waiting_consumers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((published = atomic_load_explicit(&ring->published, memory_order_acquire)) <= pos &&
+               !atomic_load(&ring->closed))
+        {
+            pthread_cond_wait(&ring->not_empty, &ring->mutex);
+        }
+        atomic_fetch_sub(&ring->nb_waiting_consumers, 1);
+        pthread_mutex_unlock(&ring->mutex);
+        break;
+    }
+
+    // A dropped consumer is never late: it has nothing more to read
+    if (atomic_load_explicit(&cursor->dropped, memory_order_relaxed))
+    {
+        return 0;
+    }
+
+    // Re-read published since the ring may have been closed meanwhile
+    return atomic_load_explicit(&ring->published, memory_order_acquire) - pos;
+}
+
+const void *bcast_ring_get(bcast_ring_t *ring, int consumer, size_t i)
+{
+    size_t pos = ring->cursors[consumer].snap + i;
+    return ring->entries + (pos & ring->mask) * ring->entry_size;
+}
+
+bool bcast_ring_copy(bcast_ring_t *ring, int consumer, size_t i, void *buf, size_t len)
+{
+    bcast_cursor_t *cursor = &ring->cursors[consumer];
+    memcpy(buf, bcast_ring_get(ring, consumer, i), len < ring->entry_size ? len : ring->entry_size);
+
+    // Seqlock-like check: if the producer overwrote the entry during the
+    // copy, it moved or dropped our cursor before
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&cursor->pos, memory_order_relaxed) == cursor->snap &&
+           !atomic_load_explicit(&cursor->dropped, memory_order_relaxed);
+}
+
+void bcast_ring_release_batch(bcast_ring_t *ring, int consumer, size_t n)
+{
+    bcast_cursor_t *cursor = &ring->cursors[consumer];
+    size_t pos = cursor->snap;
+
+    if (ring->lag_policy == BCAST_SKIP)
+    {
+        // The producer may have moved the cursor to the head: keep its value,
+        // but these n entries were read, not lost
+        if (!atomic_compare_exchange_strong(&cursor->pos, &pos, pos + n))
+        {
+            atomic_fetch_sub(&cursor->skipped, n);
+            return;
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&cursor->pos, pos + n, memory_order_release);
+    }
+
+    // Only the producer can wait on us, and only when the ring is full
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->producer_waiting, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_signal(&ring->not_full);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+const void *bcast_ring_peek(bcast_ring_t *ring, int consumer)
+{
+    bcast_ring_wait(ring, consumer);
+    return bcast_ring_get(ring, consumer, 0);
+}
+
+void bcast_ring_release(bcast_ring_t *ring, int consumer)
+{
+    bcast_ring_release_batch(ring, consumer, 1);
+}
@@ -0,0 +1,106 @@
+#ifndef _BCAST_RING_H_
+#define _BCAST_RING_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define CACHE_LINE_SIZE 64
+
+// What the producer does when a consumer is max_lag entries behind
+enum {
+    BCAST_BLOCK,  // wait for the laggard (default)
+    BCAST_DROP,   // detach the laggard: its next wait returns 0
+    BCAST_SKIP,   // move the laggard's cursor to the head, it loses what it did not read
+};
+
+// Read cursor of one consumer: number of entries it has consumed
+// Each cursor has its own cache line. Only its consumer writes pos, except
+// the producer which may move it forward (skip) or drop the consumer
+typedef struct {
+    size_t _Atomic pos;
+    size_t snap;                // Consumer only: pos when it started reading
+    int _Atomic dropped;
+    size_t _Atomic skipped;     // Number of entries the consumer lost
+} __attribute__((aligned(CACHE_LINE_SIZE))) bcast_cursor_t;
+
+// Single-producer, multi-consumer broadcast ring (Disruptor style)
+// Every consumer sees every entry. The entries are preallocated and the
+// producer reuses an entry once the slowest cursor has passed it
+typedef struct {
+    size_t _Atomic published __attribute__((aligned(CACHE_LINE_SIZE)));  // number of published entries
+    size_t claimed;             // Producer only: number of claimed entries (>= published)
+    size_t min_cursor;          // Producer only: last known position of the slowest consumer
+
+    // Slow path only: used to sleep when the ring is full or empty
+    int _Atomic producer_waiting __attribute__((aligned(CACHE_LINE_SIZE)));
+    int _Atomic nb_waiting_consumers;
+    int _Atomic closed;         // Set by the producer when it will not publish anymore
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+
+    size_t mask;
+    size_t max_lag;             // <= capacity
+    int lag_policy;
+    size_t entry_size;
+    char *entries;
+    int nb_consumers;
+    bcast_cursor_t *cursors;
+} bcast_ring_t;
+
+// capacity is rounded up to a power of two
+extern bcast_ring_t *bcast_ring_create(size_t capacity, size_t entry_size, int nb_consumers);
+extern void bcast_ring_destroy(bcast_ring_t *ring);
+
+// Bound the lag of the consumers (the capacity by default) and choose what
+// happens to a consumer that reaches it. Call it before using the ring
+// With BCAST_DROP and BCAST_SKIP, the producer may overwrite the entries a
+// laggard is reading: such a consumer must read with bcast_ring_copy.
+// A consumer is only dropped while another one keeps up: when they all lag,
+// the producer waits for them instead, so the last consumer attached is never
+// dropped. With BCAST_SKIP, the producer stays within max_lag of a leader (the
+// most advanced of the consumers that lost the fewest entries) and moves the
+// other laggards to the head, so at least one consumer reads everything
+extern void bcast_ring_set_lag_policy(bcast_ring_t *ring, size_t max_lag, int policy);
+
+// Producer: claim the next entry (waits for the slowest consumer if the ring
+// is full), fill it, then make it visible to all the consumers
+// publish makes all the entries claimed so far visible with a single wakeup,
+// so a batch is simply several claims followed by one publish
+extern void *bcast_ring_claim(bcast_ring_t *ring);
+extern void bcast_ring_publish(bcast_ring_t *ring);
+
+// Consumer: wait for the next entry of this consumer, read it in place, then
+// release it so that the producer can eventually reuse it
+extern const void *bcast_ring_peek(bcast_ring_t *ring, int consumer);
+extern void bcast_ring_release(bcast_ring_t *ring, int consumer);
+
+// Batched consumer: wait returns the number of entries available to this
+// consumer (at least one), get reads the i-th of them in place, and
+// release_batch releases the n first of them at once
+// wait returns 0 only once the ring is closed and this consumer has read everything
+extern size_t bcast_ring_wait(bcast_ring_t *ring, int consumer);
+extern const void *bcast_ring_get(bcast_ring_t *ring, int consumer, size_t i);
+extern void bcast_ring_release_batch(bcast_ring_t *ring, int consumer, size_t n);
+
+// Number of entries available to this consumer right now, without waiting
+// Like wait, it starts a read: get and release_batch are relative to it
+extern size_t bcast_ring_available(bcast_ring_t *ring, int consumer);
+
+// Copy (at most len bytes of) the i-th available entry to buf, returns false if the producer dropped
+// or skipped this consumer meanwhile: the copy may be torn, and the consumer
+// must only release the i entries it copied before (so that they are not
+// counted as skipped), then wait again
+extern bool bcast_ring_copy(bcast_ring_t *ring, int consumer, size_t i, void *buf, size_t len);
+
+// Live counters, any thread can read them
+extern size_t bcast_ring_lag(bcast_ring_t *ring, int consumer);
+extern size_t bcast_ring_skipped(bcast_ring_t *ring, int consumer);
+extern bool bcast_ring_dropped(bcast_ring_t *ring, int consumer);
+
+// Producer: publish what is claimed and wake up the consumers for good
+extern void bcast_ring_close(bcast_ring_t *ring);
+
+#endif
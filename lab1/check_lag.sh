@@ -0,0 +1,44 @@
+#!/bin/bash
+# Checks the lag policies of the broadcast ring: whatever the laggards lose,
+# the fastest consumer of multicast_queue must receive every line, in order
+# Run after compile.sh, from this directory
+
+m_q=${1:-./m_q}
+nb_lines=20000
+in=$(mktemp)
+out=$(mktemp)
+err=$(mktemp)
+trap 'rm -f $in $out $err' EXIT
+seq $nb_lines > $in
+
+status=0
+for policy in drop skip; do
+    for args in "1 merged 64" "8 merged 64" "1 merged 512"; do
+        if ! timeout 60 $m_q ring $args $policy < $in > $out 2> $err; then
+            echo "FAIL ring $args $policy: exit status $?"
+            status=1
+            continue
+        fi
+
+        best=$(sed -n 's/^\[Consumer \([0-9]*\)\] Consumed: .*/\1/p' $out | sort | uniq -c | sort -rn | head -1 | awk '{print $2}')
+        if ! grep "^\[Consumer $best\] Consumed: " $out | sed 's/.*Consumed: //' | cmp -s - $in; then
+            echo "FAIL ring $args $policy: consumer $best did not receive every line"
+            status=1
+            continue
+        fi
+
+        # Under skip, every line a consumer did not receive was counted as skipped
+        if [ $policy = skip ]; then
+            for c in $(sed -n 's/^\[Consumer \([0-9]*\)\] Consumed: .*/\1/p' $out | sort -u); do
+                received=$(grep -c "^\[Consumer $c\] Consumed: " $out)
+                skipped=$(tail -1 $err | sed -n "s/.*\[Consumer $c\] lag [0-9]* skipped \([0-9]*\).*/\1/p")
+                if [ $((received + skipped)) -ne $nb_lines ]; then
+                    echo "FAIL ring $args $policy: consumer $c received $received and skipped $skipped lines"
+                    status=1
+                fi
+            done
+        fi
+        echo "ok   ring $args $policy"
+    done
+done
+exit $status
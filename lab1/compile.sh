@@ -2,10 +2,12 @@
 
 gcc -o s_1 solution_1.c -pthread
 gcc -o s_2 solution_2.c -pthread
-gcc -o s_3a solution_3a.c -pthread
-gcc -o s_3bc solution_3bc.c -pthread
+gcc -o s_3a solution_3a.c ../node_pool.c ../line_reader.c -pthread
+gcc -o s_3bc solution_3bc.c ../node_pool.c -pthread
+gcc -o s_3bc_f solution_3bc_futex.c ../node_pool.c -pthread
 
 gcc -o t_a thread_app.c -pthread
-gcc -o p_c producer_consumer.c -pthread
-gcc -o m_q multicast_queue.c -pthread
-gcc -o d_q desync_queue.c -pthread
\ No newline at end of file
+gcc -o p_c producer_consumer.c mpmc_ring.c line_reader.c node_pool.c -pthread
+gcc -o m_q multicast_queue.c bcast_ring.c line_reader.c node_pool.c out_buf.c -pthread
+gcc -o d_q desync_queue.c node_pool.c out_buf.c -pthread
+gcc -O2 -o q_b queue_bench.c mpmc_ring.c bcast_ring.c node_pool.c -pthread
\ No newline at end of file
@@ -3,13 +3,16 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include "node_pool.h"
+#include "out_buf.h"
 
 #define MAX_LINE_LENGTH 256
 #define NUM_CONSUMERS 3  // Number of consumers
 
 // Node structure for the linked-list queue
+// The line is stored in the node, which comes from a per-thread pool
 typedef struct Node {
-    char *line;
+    char line[MAX_LINE_LENGTH];
     struct Node *next;
     int consumers_left;  // Number of consumers that still need to process this node
 } Node;
@@ -24,11 +27,20 @@ typedef struct {
 Queue queue = {NULL, NULL};
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+node_pool_t *node_pool = NULL;
+int done = 0;  // Set under the mutex when the producer reached the end of the input
+
+// Output: one buffer per consumer, or one buffer shared by all the consumers
+// to merge their streams. Either way, nothing is written under the queue lock
+int merged = 1;
+out_buf_t *shared_out = NULL;
 
 // Enqueue function: adds a new line to the queue
 void enqueue(Queue *q, const char *line) {
-    Node *new_node = (Node *)malloc(sizeof(Node));
-    new_node->line = strdup(line);  // Copy the input line
+    Node *new_node = (Node *)node_pool_alloc(node_pool);
+    size_t len = strnlen(line, MAX_LINE_LENGTH - 1);  // Copy the input line
+    memcpy(new_node->line, line, len);
+    new_node->line[len] = '\0';
     new_node->next = NULL;
     new_node->consumers_left = NUM_CONSUMERS;  // Set the number of consumers who need to process this node
 
@@ -51,6 +63,8 @@ void enqueue(Queue *q, const char *line) {
 void* consumer_function(void* arg) {
     int consumer_id = *((int*)arg);
     Node *current_node = NULL;
+    out_buf_t *out = merged ? shared_out : out_buf_create(STDOUT_FILENO, OUT_BUF_SIZE, 0);
+    char line[MAX_LINE_LENGTH];
 
     while (1) {
         pthread_mutex_lock(&mutex);
@@ -64,12 +78,25 @@ void* consumer_function(void* arg) {
 
         // Wait until there is a node to process
         while (current_node == NULL) {
+            if (done) {
+                pthread_mutex_unlock(&mutex);
+                goto exit;
+            }
+
+            // Flush our output before sleeping, without holding the queue lock
+            pthread_mutex_unlock(&mutex);
+            out_buf_flush(out);
+            pthread_mutex_lock(&mutex);
+            if ((current_node = queue.head) != NULL) {
+                break;
+            }
+
             pthread_cond_wait(&cond, &mutex);
             current_node = queue.head;  // Recheck from the head when signaled
         }
 
-        // Print the line processed by this consumer
-        printf("[Consumer %d] Consumed: %s", consumer_id, current_node->line);
+        // Keep a copy of the line, it is printed once the queue lock is released
+        strcpy(line, current_node->line);
 
         // Decrement the consumers_left counter for this node
         current_node->consumers_left--;
@@ -82,23 +109,43 @@ void* consumer_function(void* arg) {
                     queue.tail = NULL;  // If the queue is now empty, reset the tail
                 }
             }
-            free(current_node->line);
-            free(current_node);
+            node_pool_free(node_pool, current_node);
         }
 
         pthread_mutex_unlock(&mutex);
 
+        // Print the line processed by this consumer
+        out_buf_printf(out, "[Consumer %d] Consumed: %s", consumer_id, line);
+
         // Sleep for a short time to simulate work
         usleep(100000);  // 100ms
     }
 
+exit:
+    if (merged) {
+        out_buf_flush(out);
+    } else {
+        out_buf_destroy(out);
+    }
     pthread_exit(NULL);
 }
 
-int main() {
+int main(int argc, char** argv) {
     pthread_t consumers[NUM_CONSUMERS];
     int consumer_ids[NUM_CONSUMERS];
 
+    // Merge the consumer streams in one output (default) or give each its own
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "merged") != 0 && strcmp(argv[1], "separate") != 0)) {
+        fprintf(stderr, "Usage: %s [merged|separate]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    merged = argc < 2 || strcmp(argv[1], "merged") == 0;
+    if (merged) {
+        shared_out = out_buf_create(STDOUT_FILENO, OUT_BUF_SIZE, 1);
+    }
+
+    node_pool = node_pool_create(sizeof(Node));
+
     // Create consumer threads
     for (int i = 0; i < NUM_CONSUMERS; i++) {
         consumer_ids[i] = i + 1;  // Assign an ID to each consumer
@@ -114,10 +161,20 @@ int main() {
         enqueue(&queue, input);
     }
 
+    // Tell the consumers that nothing more will come
+    pthread_mutex_lock(&mutex);
+    done = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+
     // Join consumer threads
     for (int i = 0; i < NUM_CONSUMERS; i++) {
         pthread_join(consumers[i], NULL);
     }
 
+    if (merged) {
+        out_buf_destroy(shared_out);
+    }
+
     return 0;
 }
@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "line_reader.h"
+
+line_reader_t *line_reader_open(int fd)
+{
+    line_reader_t *reader = calloc(1, sizeof(*reader));
+    struct stat st;
+
+    pthread_mutex_init(&reader->mutex, NULL);
+    reader->fd = fd;
+
+    // A regular file is mapped once, the blocks are then just windows on it
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            reader->mapping = malloc(sizeof(*reader->mapping));
+            atomic_init(&reader->mapping->refs, 1);  // Reference of the reader
+            reader->mapping->addr = addr;
+            reader->mapping->size = st.st_size;
+        }
+    }
+
+    return reader;
+}
+
+static void mapping_release(line_mapping_t *mapping)
+{
+    if (atomic_fetch_sub(&mapping->refs, 1) == 1)
+    {
+        munmap(mapping->addr, mapping->size);
+        free(mapping);
+    }
+}
+
+void line_reader_close(line_reader_t *reader)
+{
+    if (reader->mapping != NULL)
+    {
+        mapping_release(reader->mapping);
+    }
+    pthread_mutex_destroy(&reader->mutex);
+    free(reader->pending);
+    free(reader);
+}
+
+void line_block_release(line_block_t *block)
+{
+    if (atomic_fetch_sub(&block->refs, 1) == 1)
+    {
+        if (block->mapping != NULL)
+        {
+            mapping_release(block->mapping);
+        }
+        else
+        {
+            free(block->data);
+        }
+        free(block);
+    }
+}
+
+void line_block_release_all(line_block_t *block)
+{
+    atomic_fetch_sub(&block->refs, block->nb_lines);
+    line_block_release(block);
+}
+
+// Split data into lines, the last line may lack its '\n' at the end of the input
+static line_block_t *make_block(char *data, size_t size, line_mapping_t *mapping)
+{
+    size_t nb_lines = 0;
+    for (char *cur = data, *end = data + size; cur < end; nb_lines ++)
+    {
+        char *nl = memchr(cur, '\n', end - cur);
+        cur = nl ? nl + 1 : end;
+    }
+
+    // One allocation per block for the header and all the slices
+    line_block_t *block = malloc(sizeof(*block) + nb_lines * sizeof(line_t));
+    atomic_init(&block->refs, nb_lines + 1);  // One per line plus the caller
+    block->mapping = mapping;
+    block->data = data;
+    block->nb_lines = nb_lines;
+    block->lines = (line_t *)(block + 1);
+
+    char *cur = data, *end = data + size;
+    for (size_t i = 0; i < nb_lines; i ++)
+    {
+        char *nl = memchr(cur, '\n', end - cur);
+        char *next = nl ? nl + 1 : end;
+        block->lines[i].ptr = cur;
+        block->lines[i].len = next - cur;
+        block->lines[i].block = block;
+        cur = next;
+    }
+
+    return block;
+}
+
+static line_block_t *map_block(line_reader_t *reader)
+{
+    line_mapping_t *mapping = reader->mapping;
+    char *addr = mapping->addr;
+    size_t from = reader->offset;
+    size_t to = from + LINE_BLOCK_SIZE;
+
+    if (from >= mapping->size)
+    {
+        return NULL;
+    }
+
+    // Cut the window after the last complete line
+    if (to >= mapping->size)
+    {
+        to = mapping->size;
+    }
+    else
+    {
+        char *nl = memrchr(addr + from, '\n', to - from);
+        if (nl == NULL)  // Line longer than a block
+        {
+            nl = memchr(addr + to, '\n', mapping->size - to);
+        }
+        to = nl ? nl - addr + 1 : mapping->size;
+    }
+
+    reader->offset = to;
+    atomic_fetch_add(&mapping->refs, 1);
+    return make_block(addr + from, to - from, mapping);
+}
+
+static line_block_t *read_block(line_reader_t *reader)
+{
+    if (reader->eof)
+    {
+        return NULL;
+    }
+
+    // Start with the incomplete line left by the previous block
+    size_t capacity = reader->nb_pending + LINE_BLOCK_SIZE;
+    char *buf = malloc(capacity);
+    size_t n = reader->nb_pending;
+    size_t cut;
+
+    memcpy(buf, reader->pending, reader->nb_pending);
+    reader->nb_pending = 0;
+
+    // A single read is enough as soon as it completes a line, so that an
+    // interactive input is not delayed until a full block is available
+    for (;;)
+    {
+        if (n == capacity)
+        {
+            capacity *= 2;
+            buf = realloc(buf, capacity);
+        }
+
+        ssize_t res = read(reader->fd, buf + n, capacity - n);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            reader->eof = true;
+            cut = n;
+            break;
+        }
+
+        char *nl = memrchr(buf + n, '\n', res);
+        n += res;
+        if (nl != NULL)
+        {
+            cut = nl - buf + 1;
+            break;
+        }
+    }
+
+    if (n == 0)
+    {
+        free(buf);
+        return NULL;
+    }
+
+    if (n > cut)
+    {
+        reader->nb_pending = n - cut;
+        reader->pending = realloc(reader->pending, reader->nb_pending);
+        memcpy(reader->pending, buf + cut, reader->nb_pending);
+    }
+
+    return make_block(buf, cut, NULL);
+}
+
+line_block_t *line_reader_next_block(line_reader_t *reader)
+{
+    pthread_mutex_lock(&reader->mutex);
+    line_block_t *block = reader->mapping ? map_block(reader) : read_block(reader);
+    pthread_mutex_unlock(&reader->mutex);
+
+    return block;
+}
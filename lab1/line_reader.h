@@ -0,0 +1,68 @@
+#ifndef _LINE_READER_H_
+#define _LINE_READER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define LINE_BLOCK_SIZE (1 << 20)  // bytes read (or mapped) at once
+
+struct line_block;
+
+// A line is a (pointer, length) slice into a block: nothing is copied
+// Every line holds one reference on its block, drop it with line_release
+typedef struct line {
+    const char *ptr;
+    size_t len;
+    struct line_block *block;
+} line_t;
+
+// A block of input split into lines
+// The block is freed when the last of its lines has been released
+typedef struct line_block {
+    int _Atomic refs;
+    struct line_mapping *mapping;  // Not NULL if data points into a mmaped file
+    char *data;
+    size_t nb_lines;
+    line_t *lines;
+} line_block_t;
+
+// A mmaped file, shared by all the blocks that point into it
+typedef struct line_mapping {
+    int _Atomic refs;
+    void *addr;
+    size_t size;
+} line_mapping_t;
+
+typedef struct {
+    pthread_mutex_t mutex;  // Several producers can share the same reader
+    int fd;
+    line_mapping_t *mapping;
+    size_t offset;          // Next byte of the mapping to hand out
+    char *pending;          // Read mode: incomplete line left by the previous block
+    size_t nb_pending;
+    bool eof;
+} line_reader_t;
+
+// Reads fd by large blocks, or mmaps it when it is a regular file
+extern line_reader_t *line_reader_open(int fd);
+extern void line_reader_close(line_reader_t *reader);
+
+// Returns the next block, or NULL at the end of the input
+// The caller owns one extra reference on the block and must release it with
+// line_block_release once it has handed out all the lines
+extern line_block_t *line_reader_next_block(line_reader_t *reader);
+
+extern void line_block_release(line_block_t *block);
+
+// Releases the block together with all its lines, when they were copied
+// instead of being handed out
+extern void line_block_release_all(line_block_t *block);
+
+static inline void line_release(line_t *line)
+{
+    line_block_release(line->block);
+}
+
+#endif
@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "mpmc_ring.h"
+
+#define asm_pause() asm volatile("pause")
+#define SPIN_TRIES 128  // number of failed attempts before going to sleep
+
+mpmc_ring_t *mpmc_ring_create(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    mpmc_ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(*ring));
+    ring->slots = aligned_alloc(CACHE_LINE_SIZE, size * sizeof(mpmc_slot_t));
+    ring->mask = size - 1;
+
+    for (size_t i = 0; i < size; i ++)
+    {
+        atomic_init(&ring->slots[i].seq, i);
+        ring->slots[i].value = NULL;
+    }
+
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->nb_waiting_producers, 0);
+    atomic_init(&ring->nb_waiting_consumers, 0);
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+
+    return ring;
+}
+
+void mpmc_ring_destroy(mpmc_ring_t *ring)
+{
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->not_full);
+    pthread_cond_destroy(&ring->not_empty);
+    free(ring->slots);
+    free(ring);
+}
+
+// Wake the sleepers of the other side, if any
+// The fence pairs with the one in the slow paths: either the sleeper sees our
+// update of the slot, or we see its increment of the waiting counter
+// After a batch, all the sleepers are woken since there may be work for all
+static void wake(mpmc_ring_t *ring, int _Atomic *nb_waiting, pthread_cond_t *cond, bool all)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(nb_waiting, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&ring->mutex);
+        if (all)
+        {
+            pthread_cond_broadcast(cond);
+        }
+        else
+        {
+            pthread_cond_signal(cond);
+        }
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+static bool try_enqueue(mpmc_ring_t *ring, void *value)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    for (;;)
+    {
+        mpmc_slot_t *slot = &ring->slots[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0)
+        {
+            // The slot is free for this lap: try to claim the position
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                slot->value = value;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false;  // The consumers did not free the slot yet: the ring is full
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);  // Another producer took it
+        }
+    }
+}
+
+static bool try_dequeue(mpmc_ring_t *ring, void **value)
+{
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (;;)
+    {
+        mpmc_slot_t *slot = &ring->slots[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                *value = slot->value;
+                atomic_store_explicit(&slot->seq, pos + ring->mask + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false;  // Not yet published: the ring is empty
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Claim up to n consecutive positions starting at *counter
+// A slot is usable if its sequence number equals pos + offset, offset being 0
+// for producers (free slot) and 1 for consumers (published slot)
+static size_t claim(mpmc_ring_t *ring, size_t _Atomic *counter, size_t offset, size_t n, size_t *first)
+{
+    size_t pos = atomic_load_explicit(counter, memory_order_relaxed);
+
+    for (;;)
+    {
+        size_t k = 0;
+        while (k < n && k <= ring->mask)
+        {
+            mpmc_slot_t *slot = &ring->slots[(pos + k) & ring->mask];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + k + offset)
+            {
+                break;
+            }
+            k ++;
+        }
+
+        if (k == 0)
+        {
+            // Either the ring is full (resp. empty) or another thread moved the counter
+            size_t cur = atomic_load_explicit(counter, memory_order_relaxed);
+            if (cur == pos)
+            {
+                return 0;
+            }
+            pos = cur;
+        }
+        else if (atomic_compare_exchange_weak_explicit(counter, &pos, pos + k,
+                                                       memory_order_relaxed, memory_order_relaxed))
+        {
+            *first = pos;
+            return k;
+        }
+    }
+}
+
+static size_t try_enqueue_batch(mpmc_ring_t *ring, void **values, size_t n)
+{
+    size_t pos;
+    size_t k = claim(ring, &ring->tail, 0, n, &pos);
+
+    for (size_t i = 0; i < k; i ++)
+    {
+        mpmc_slot_t *slot = &ring->slots[(pos + i) & ring->mask];
+        slot->value = values[i];
+        atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t try_dequeue_batch(mpmc_ring_t *ring, void **values, size_t max)
+{
+    size_t pos;
+    size_t k = claim(ring, &ring->head, 1, max, &pos);
+
+    for (size_t i = 0; i < k; i ++)
+    {
+        mpmc_slot_t *slot = &ring->slots[(pos + i) & ring->mask];
+        values[i] = slot->value;
+        atomic_store_explicit(&slot->seq, pos + i + ring->mask + 1, memory_order_release);
+    }
+    return k;
+}
+
+bool mpmc_ring_try_enqueue(mpmc_ring_t *ring, void *value)
+{
+    if (!try_enqueue(ring, value))
+    {
+        return false;
+    }
+    wake(ring, &ring->nb_waiting_consumers, &ring->not_empty, false);
+    return true;
+}
+
+bool mpmc_ring_try_dequeue(mpmc_ring_t *ring, void **value)
+{
+    if (!try_dequeue(ring, value))
+    {
+        return false;
+    }
+    wake(ring, &ring->nb_waiting_producers, &ring->not_full, false);
+    return true;
+}
+
+void mpmc_ring_enqueue(mpmc_ring_t *ring, void *value)
+{
+    for (int i = 0; i < SPIN_TRIES; i ++)
+    {
+        if (mpmc_ring_try_enqueue(ring, value))
+        {
+            return;
+        }
+        asm_pause();
+    }
+
+    // Slow path: the ring is full, sleep until a consumer frees a slot
+    pthread_mutex_lock(&ring->mutex);
+    atomic_fetch_add(&ring->nb_waiting_producers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!try_enqueue(ring, value))
+    {
+        pthread_cond_wait(&ring->not_full, &ring->mutex);
+    }
+    atomic_fetch_sub(&ring->nb_waiting_producers, 1);
+    pthread_mutex_unlock(&ring->mutex);
+
+    wake(ring, &ring->nb_waiting_consumers, &ring->not_empty, false);
+}
+
+void *mpmc_ring_dequeue(mpmc_ring_t *ring)
+{
+    void *value;
+
+    for (int i = 0; i < SPIN_TRIES; i ++)
+    {
+        if (mpmc_ring_try_dequeue(ring, &value))
+        {
+            return value;
+        }
+        asm_pause();
+    }
+
+    // Slow path: the ring is empty, sleep until a producer publishes a slot
+    pthread_mutex_lock(&ring->mutex);
+    atomic_fetch_add(&ring->nb_waiting_consumers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!try_dequeue(ring, &value))
+    {
+        pthread_cond_wait(&ring->not_empty, &ring->mutex);
+    }
+    atomic_fetch_sub(&ring->nb_waiting_consumers, 1);
+    pthread_mutex_unlock(&ring->mutex);
+
+    wake(ring, &ring->nb_waiting_producers, &ring->not_full, false);
+
+    return value;
+}
+
+void mpmc_ring_enqueue_batch(mpmc_ring_t *ring, void **values, size_t n)
+{
+    while (n > 0)
+    {
+        size_t k = 0;
+
+        for (int i = 0; i < SPIN_TRIES && k == 0; i ++)
+        {
+            if ((k = try_enqueue_batch(ring, values, n)) == 0)
+            {
+                asm_pause();
+            }
+        }
+
+        if (k == 0)
+        {
+            pthread_mutex_lock(&ring->mutex);
+            atomic_fetch_add(&ring->nb_waiting_producers, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            while ((k = try_enqueue_batch(ring, values, n)) == 0)
+            {
+                pthread_cond_wait(&ring->not_full, &ring->mutex);
+            }
+            atomic_fetch_sub(&ring->nb_waiting_producers, 1);
+            pthread_mutex_unlock(&ring->mutex);
+        }
+
+        wake(ring, &ring->nb_waiting_consumers, &ring->not_empty, k > 1);
+        values += k;
+        n -= k;
+    }
+}
+
+size_t mpmc_ring_dequeue_batch(mpmc_ring_t *ring, void **values, size_t max)
+{
+    size_t k = 0;
+
+    for (int i = 0; i < SPIN_TRIES && k == 0; i ++)
+    {
+        if ((k = try_dequeue_batch(ring, values, max)) == 0)
+        {
+            asm_pause();
+        }
+    }
+
+    if (k == 0)
+    {
+        pthread_mutex_lock(&ring->mutex);
+        atomic_fetch_add(&ring->nb_waiting_consumers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((k = try_dequeue_batch(ring, values, max)) == 0)
+        {
+            pthread_cond_wait(&ring->not_empty, &ring->mutex);
+        }
+        atomic_fetch_sub(&ring->nb_waiting_consumers, 1);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+
+    wake(ring, &ring->nb_waiting_producers, &ring->not_full, k > 1);
+
+    return k;
+}
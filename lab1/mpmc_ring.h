@@ -0,0 +1,58 @@
+#ifndef _MPMC_RING_H_
+#define _MPMC_RING_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define CACHE_LINE_SIZE 64
+
+// One slot of the ring: the sequence number tells who may use the slot next
+//   seq == pos         => free, the producer that claimed pos can write it
+//   seq == pos + 1     => full, the consumer that claimed pos can read it
+//   seq == pos + size  => free again for the next lap
+typedef struct {
+    size_t _Atomic seq;
+    void *value;
+} __attribute__((aligned(CACHE_LINE_SIZE))) mpmc_slot_t;
+
+// Bounded multi-producer/multi-consumer ring buffer
+// head and tail live on their own cache lines so that producers and consumers
+// do not invalidate each other when the ring is neither full nor empty
+typedef struct {
+    size_t _Atomic tail __attribute__((aligned(CACHE_LINE_SIZE)));   // next position to enqueue
+    size_t _Atomic head __attribute__((aligned(CACHE_LINE_SIZE)));   // next position to dequeue
+
+    // Slow path only: used to sleep when the ring is full or empty
+    int _Atomic nb_waiting_producers __attribute__((aligned(CACHE_LINE_SIZE)));
+    int _Atomic nb_waiting_consumers;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+
+    size_t mask;
+    mpmc_slot_t *slots;
+} mpmc_ring_t;
+
+// capacity is rounded up to a power of two
+extern mpmc_ring_t *mpmc_ring_create(size_t capacity);
+extern void mpmc_ring_destroy(mpmc_ring_t *ring);
+
+// Non-blocking versions: return false if the ring is full (resp. empty)
+extern bool mpmc_ring_try_enqueue(mpmc_ring_t *ring, void *value);
+extern bool mpmc_ring_try_dequeue(mpmc_ring_t *ring, void **value);
+
+// Blocking versions: sleep only when the ring is full (resp. empty)
+extern void mpmc_ring_enqueue(mpmc_ring_t *ring, void *value);
+extern void *mpmc_ring_dequeue(mpmc_ring_t *ring);
+
+// Batched versions: claim several consecutive slots with a single CAS and
+// wake the other side at most once per batch
+// enqueue_batch blocks until the n values are in the ring
+// dequeue_batch blocks until at least one value is available, returns the
+// number of values stored in values (at most max)
+extern void mpmc_ring_enqueue_batch(mpmc_ring_t *ring, void **values, size_t n);
+extern size_t mpmc_ring_dequeue_batch(mpmc_ring_t *ring, void **values, size_t max);
+
+#endif
@@ -3,31 +3,64 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <stdatomic.h>
+#include "bcast_ring.h"
+#include "line_reader.h"
+#include "node_pool.h"
+#include "out_buf.h"
 
 #define MAX_LINE_LENGTH 256
 #define NUM_CONSUMERS 3  // number of consumers
+#define RING_CAPACITY 1024  // number of lines buffered by the ring engine
+#define LAG_REPORT_MS 100   // period of the live lag report
 
+// The line is stored in the node, which comes from a per-thread pool
 typedef struct Node {
-    char *line;
+    char line[MAX_LINE_LENGTH];
     struct Node *next;
     int consumers_left;  // Number of consumers that still need to process this node
 } Node;
 
+// If ring is not NULL, the broadcast ring engine is used instead of the list
 typedef struct {
     Node *head;
     Node *tail;
+    bcast_ring_t *ring;
 } Queue;
 
 // Shared queue and synchronization primitives
-Queue queue = {NULL, NULL};
+Queue queue = {NULL, NULL, NULL};
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+int batch_size = 1;  // Maximum number of lines moved per lock acquisition (or ring publication)
+node_pool_t *node_pool = NULL;
+int done = 0;  // Set under the mutex when the producer reached the end of the input
+
+// Output: one buffer per consumer, or one buffer shared by all the consumers
+// to merge their streams. Either way, nothing is written under the queue lock
+bool merged = true;
+out_buf_t *shared_out = NULL;
+
+// Bounded lag of the ring engine: see bcast_ring_set_lag_policy
+int lag_policy = BCAST_BLOCK;
+int _Atomic reporting = 0;  // The lag reporter runs while it is set
 
 // Enqueue function: adds a new line to the queue
 void enqueue(Queue *q, const char *line) 
 {
-    Node *new_node = (Node *)malloc(sizeof(Node));
-    new_node->line = strdup(line); // Copy the input line
+    if (q->ring != NULL) 
+    {
+        // Copy the line directly in the preallocated entry, no malloc nor lock
+        char *entry = bcast_ring_claim(q->ring);
+        strncpy(entry, line, MAX_LINE_LENGTH);
+        bcast_ring_publish(q->ring);
+        return;
+    }
+
+    Node *new_node = (Node *)node_pool_alloc(node_pool);
+    size_t len = strnlen(line, MAX_LINE_LENGTH - 1);  // Copy the input line
+    memcpy(new_node->line, line, len);
+    new_node->line[len] = '\0';
     new_node->next = NULL;
     new_node->consumers_left = NUM_CONSUMERS;  // Set the number of consumers who need to process this node
 
@@ -49,78 +82,452 @@ void enqueue(Queue *q, const char *line)
     pthread_mutex_unlock(&mutex);
 }
 
-// Dequeue function: returns the oldest line in the queue if available
-Node* dequeue(Queue *q) 
+// Flush the output of a consumer that is about to sleep, without the queue lock
+void flush_before_waiting(out_buf_t *out) 
 {
+    pthread_mutex_unlock(&mutex);
+    out_buf_flush(out);
     pthread_mutex_lock(&mutex);
+}
+
+// Every consumer reads every node in order. Its position is the last node it
+// read, in which it still counts: a node is freed once all the consumers moved
+// past it, so the node a consumer holds, and its next pointer, stay valid
+// without the lock. Nodes are freed in order, the freed one is always the head
+
+// Next node to read after last (NULL: nothing read yet)
+static Node* next_node(Queue *q, Node *last) 
+{
+    return last == NULL ? q->head : last->next;
+}
+
+// The consumer moves past node, with the lock held
+static void release_node(Queue *q, Node *node) 
+{
+    if (node == NULL) 
+    {
+        return;
+    }
+
+    // If all consumers have processed this node, free it
+    if (-- node->consumers_left == 0) 
+    {
+        q->head = node->next;  // Move the head to the next node
+        if (q->head == NULL) 
+        {
+            q->tail = NULL;  // If the queue becomes empty, reset the tail
+        }
+        node_pool_free(node_pool, node);
+    }
+}
+
+// Dequeue function: returns the line after last, NULL once the producer is
+// done and the consumer read everything. last is released, the returned node
+// is held until the next call
+Node* dequeue(Queue *q, Node *last, out_buf_t *out) 
+{
+    pthread_mutex_lock(&mutex);
+
+    if (next_node(q, last) == NULL && !done) 
+    {
+        flush_before_waiting(out);
+    }
 
-    // Wait if the queue is empty
-    while (q->head == NULL) 
+    // Wait if the consumer read everything
+    while (next_node(q, last) == NULL && !done) 
     {
         pthread_cond_wait(&cond, &mutex);
     }
 
-    Node *node = q->head;  // Get the first node (FIFO)
+    Node *node = next_node(q, last);
+    release_node(q, last);
 
     pthread_mutex_unlock(&mutex);
     return node;
 }
 
-// Function to be called by each consumer thread
-void* consumer_function(void* arg) 
+// Batched enqueue: adds n lines with one lock acquisition and one wakeup
+void enqueue_batch(Queue *q, const line_t *lines, int n) 
 {
-    int consumer_id = *((int*)arg);
+    if (n == 0) 
+    {
+        return;
+    }
 
-    while (1) 
+    if (q->ring != NULL) 
     {
-        Node *node = dequeue(&queue);
+        // Claim and fill all the entries, then publish them at once
+        for (int i = 0; i < n; i ++) 
+        {
+            char *entry = bcast_ring_claim(q->ring);
+            size_t len = lines[i].len < MAX_LINE_LENGTH ? lines[i].len : MAX_LINE_LENGTH - 1;
+            memcpy(entry, lines[i].ptr, len);
+            entry[len] = '\0';
+        }
+        bcast_ring_publish(q->ring);
+        return;
+    }
 
-        // Print the line processed by this consumer
-        pthread_mutex_lock(&mutex);
-        printf("[Consumer %d] Consumed: %s", consumer_id, node->line);
+    // Build the chain outside the lock
+    Node *first = NULL, *last = NULL;
+    for (int i = 0; i < n; i ++) 
+    {
+        Node *new_node = (Node *)node_pool_alloc(node_pool);
+        size_t len = lines[i].len < MAX_LINE_LENGTH ? lines[i].len : MAX_LINE_LENGTH - 1;
+        memcpy(new_node->line, lines[i].ptr, len);
+        new_node->line[len] = '\0';
+        new_node->next = NULL;
+        new_node->consumers_left = NUM_CONSUMERS;
+        if (last == NULL) 
+        {
+            first = new_node;
+        } 
+        else 
+        {
+            last->next = new_node;
+        }
+        last = new_node;
+    }
+
+    pthread_mutex_lock(&mutex);
 
-        // Decrement the consumers_left counter
-        node->consumers_left --;
+    if (q->tail == NULL) 
+    {
+        q->head = first;
+    } 
+    else 
+    {
+        q->tail->next = first;
+    }
+    q->tail = last;
 
-        // If all consumers have processed this node, free it
-        if (node->consumers_left == 0) 
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+// Batched dequeue: returns up to max of the nodes after last, 0 once the
+// producer is done and the consumer read everything. Like dequeue, it releases
+// last, and the consumer holds the returned nodes
+int dequeue_batch(Queue *q, Node *last, Node **nodes, int max, out_buf_t *out) 
+{
+    pthread_mutex_lock(&mutex);
+
+    if (next_node(q, last) == NULL && !done) 
+    {
+        flush_before_waiting(out);
+    }
+
+    while (next_node(q, last) == NULL && !done) 
+    {
+        pthread_cond_wait(&cond, &mutex);
+    }
+
+    int n = 0;
+    for (Node *node = next_node(q, last); node != NULL && n < max; node = node->next) 
+    {
+        nodes[n ++] = node;
+    }
+    release_node(q, last);
+
+    pthread_mutex_unlock(&mutex);
+    return n;
+}
+
+// Output buffer of a consumer
+out_buf_t* consumer_output() 
+{
+    return merged ? shared_out : out_buf_create(STDOUT_FILENO, OUT_BUF_SIZE, false);
+}
+
+void consumer_output_close(out_buf_t *out) 
+{
+    if (merged) 
+    {
+        out_buf_flush(out);
+    } 
+    else 
+    {
+        out_buf_destroy(out);
+    }
+}
+
+// Consumer of the ring engine: each consumer only advances its own cursor,
+// so consumers never wait for each other. Everything available (up to
+// batch_size lines) is processed before releasing the entries at once
+void* ring_consumer_function(void* arg) 
+{
+    int consumer_id = *((int*)arg);
+    out_buf_t *out = consumer_output();
+
+    while (1) 
+    {
+        size_t n = bcast_ring_available(queue.ring, consumer_id - 1);
+        if (n == 0) 
+        {
+            out_buf_flush(out);  // We are about to sleep
+            n = bcast_ring_wait(queue.ring, consumer_id - 1);
+            if (n == 0) 
+            {
+                break;  // Closed and drained
+            }
+        }
+        if (n > batch_size) 
+        {
+            n = batch_size;
+        }
+        if (lag_policy != BCAST_BLOCK) 
+        {
+            // The producer may overwrite what we read: copy and check each line
+            char line[MAX_LINE_LENGTH];
+            size_t i;
+            for (i = 0; i < n && bcast_ring_copy(queue.ring, consumer_id - 1, i, line, sizeof(line)); i ++) 
+            {
+                out_buf_printf(out, "[Consumer %d] Consumed: %s", consumer_id, line);
+            }
+            if (i < n) 
+            {
+                // Dropped or skipped: the cursor is not ours anymore
+                bcast_ring_release_batch(queue.ring, consumer_id - 1, i);
+                continue;
+            }
+        } 
+        else 
         {
-            queue.head = node->next;  // Move the head to the next node
-            if (queue.head == NULL) 
+            for (size_t i = 0; i < n; i ++) 
             {
-                queue.tail = NULL;  // If the queue becomes empty, reset the tail
+                const char *line = bcast_ring_get(queue.ring, consumer_id - 1, i);
+                out_buf_printf(out, "[Consumer %d] Consumed: %s", consumer_id, line);
             }
-            free(node->line);
-            free(node);
+        }
+        bcast_ring_release_batch(queue.ring, consumer_id - 1, n);
+    }
+
+    consumer_output_close(out);
+    pthread_exit(NULL);
+}
+
+// Batched consumer of the list: one lock acquisition for the whole batch
+void* consumer_batch_function(void* arg) 
+{
+    int consumer_id = *((int*)arg);
+    out_buf_t *out = consumer_output();
+    Node *nodes[batch_size];
+    Node *last = NULL;
+
+    while (1) 
+    {
+        int n = dequeue_batch(&queue, last, nodes, batch_size, out);
+        if (n == 0) 
+        {
+            break;
+        }
+
+        // We still count in the nodes of the batch, so they cannot be freed
+        for (int i = 0; i < n; i ++) 
+        {
+            out_buf_printf(out, "[Consumer %d] Consumed: %s", consumer_id, nodes[i]->line);
         }
 
+        // Keep the last one as our position, the next dequeue releases it
+        pthread_mutex_lock(&mutex);
+        for (int i = 0; i < n - 1; i ++) 
+        {
+            release_node(&queue, nodes[i]);
+        }
         pthread_mutex_unlock(&mutex);
+        last = nodes[n - 1];
+    }
+
+    consumer_output_close(out);
+    pthread_exit(NULL);
+}
+
+// Function to be called by each consumer thread
+void* consumer_function(void* arg) 
+{
+    int consumer_id = *((int*)arg);
+    out_buf_t *out = consumer_output();
+
+    Node *node = NULL;
+
+    while (1) 
+    {
+        // Moves past the previous node, and holds the new one
+        node = dequeue(&queue, node, out);
+        if (node == NULL) 
+        {
+            break;
+        }
+
+        // Print the line processed by this consumer, outside the queue lock:
+        // the node stays alive until our next dequeue moves past it
+        out_buf_printf(out, "[Consumer %d] Consumed: %s", consumer_id, node->line);
     }
 
+    consumer_output_close(out);
     pthread_exit(NULL);
 }
 
+// Live per-consumer lag counters, on stderr so that they do not mix with the lines
+void print_lags(const char *prefix) 
+{
+    char report[64 * NUM_CONSUMERS];
+    int len = 0;
+    for (int i = 0; i < NUM_CONSUMERS && len < sizeof(report); i ++) 
+    {
+        len += snprintf(report + len, sizeof(report) - len, " [Consumer %d] lag %zu skipped %zu%s",
+                        i + 1, bcast_ring_lag(queue.ring, i), bcast_ring_skipped(queue.ring, i),
+                        bcast_ring_dropped(queue.ring, i) ? " dropped" : "");
+    }
+    fprintf(stderr, "%s:%s\n", prefix, report);
+}
+
+void* lag_reporter_function(void* arg) 
+{
+    while (atomic_load(&reporting)) 
+    {
+        print_lags("lag");
+        usleep(LAG_REPORT_MS * 1000);
+    }
+    return NULL;
+}
+
 int main(int argc, char** argv) 
 {
     pthread_t consumers[NUM_CONSUMERS];
     int consumer_ids[NUM_CONSUMERS];
+    void* (*consumer)(void*) = consumer_function;
+
+    node_pool = node_pool_create(sizeof(Node));
+
+    // Select the queue engine at startup (the linked list is the default)
+    const char *engine = argc > 1 ? argv[1] : "list";
+    batch_size = argc > 2 ? atoi(argv[2]) : 1;
+    const char *output = argc > 3 ? argv[3] : "merged";
+    merged = strcmp(output, "merged") == 0;
+
+    // Lag bound of the ring engine, in lines or in bytes ("64k", "4096b")
+    // Every entry takes MAX_LINE_LENGTH bytes, so a byte bound is a number of entries
+    size_t max_lag = 0;
+    if (argc > 4) 
+    {
+        char *end;
+        max_lag = strtoul(argv[4], &end, 10);
+        if (*end == 'k') 
+        {
+            max_lag *= 1024;
+            end ++;
+        }
+        if (*end == 'b') 
+        {
+            max_lag = (max_lag + MAX_LINE_LENGTH - 1) / MAX_LINE_LENGTH;
+        }
+    }
+    const char *policy = argc > 5 ? argv[5] : "block";
+    if (strcmp(policy, "drop") == 0) 
+    {
+        lag_policy = BCAST_DROP;
+    } 
+    else if (strcmp(policy, "skip") == 0) 
+    {
+        lag_policy = BCAST_SKIP;
+    } 
+    else if (strcmp(policy, "block") != 0) 
+    {
+        fprintf(stderr, "unknown lag policy: %s\n", policy);
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(engine, "ring") == 0) 
+    {
+        queue.ring = bcast_ring_create(max_lag ? max_lag : RING_CAPACITY, MAX_LINE_LENGTH, NUM_CONSUMERS);
+        if (max_lag) 
+        {
+            bcast_ring_set_lag_policy(queue.ring, max_lag, lag_policy);
+        }
+        consumer = ring_consumer_function;
+    } 
+    else if (max_lag) 
+    {
+        fprintf(stderr, "a bounded lag needs the ring engine\n");
+        return EXIT_FAILURE;
+    } 
+    else if (strcmp(engine, "list") == 0 && batch_size > 1) 
+    {
+        consumer = consumer_batch_function;
+    } 
+    else if (strcmp(engine, "list") != 0 || batch_size < 1) 
+    {
+        fprintf(stderr, "Usage: %s [list|ring] [batch-size] [merged|separate] [max-lag[k][b] [block|drop|skip]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (merged) 
+    {
+        shared_out = out_buf_create(STDOUT_FILENO, OUT_BUF_SIZE, true);
+    } 
+    else if (strcmp(output, "separate") != 0) 
+    {
+        fprintf(stderr, "unknown output mode: %s\n", output);
+        return EXIT_FAILURE;
+    }
 
     // Create consumer threads
     for (int i = 0; i < NUM_CONSUMERS; i ++) 
     {
         consumer_ids[i] = i + 1;  // Assign an ID to each consumer
-        if (pthread_create(&consumers[i], NULL, consumer_function, &consumer_ids[i]) != 0) 
+        if (pthread_create(&consumers[i], NULL, consumer, &consumer_ids[i]) != 0) 
         {
             perror("Failed to create consumer thread");
             return EXIT_FAILURE;
         }
     }
 
-    // Producer: Read lines from standard input and enqueue them
-    char input[MAX_LINE_LENGTH];
-    while (fgets(input, MAX_LINE_LENGTH, stdin) != NULL) 
+    pthread_t reporter;
+    if (max_lag) 
     {
-        enqueue(&queue, input);
+        atomic_store(&reporting, 1);
+        pthread_create(&reporter, NULL, lag_reporter_function, NULL);
+    }
+
+    if (batch_size > 1) 
+    {
+        // Batched producer: a block holds what a single read brought, so a
+        // burst becomes a few large batches without delaying interactive input
+        line_reader_t *reader = line_reader_open(STDIN_FILENO);
+        line_block_t *block;
+        while ((block = line_reader_next_block(reader)) != NULL) 
+        {
+            for (size_t i = 0; i < block->nb_lines; i += batch_size) 
+            {
+                size_t n = block->nb_lines - i < batch_size ? block->nb_lines - i : batch_size;
+                enqueue_batch(&queue, &block->lines[i], n);
+            }
+            line_block_release_all(block);  // Everything was copied
+        }
+        line_reader_close(reader);
+    } 
+    else 
+    {
+        // Producer: Read lines from standard input and enqueue them
+        char input[MAX_LINE_LENGTH];
+        while (fgets(input, MAX_LINE_LENGTH, stdin) != NULL) 
+        {
+            enqueue(&queue, input);
+        }
+    }
+
+    // Tell the consumers that nothing more will come
+    if (queue.ring != NULL) 
+    {
+        bcast_ring_close(queue.ring);
+    } 
+    else 
+    {
+        pthread_mutex_lock(&mutex);
+        done = 1;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
     }
 
     // Join consumer threads
@@ -129,5 +536,17 @@ int main(int argc, char** argv)
         pthread_join(consumers[i], NULL);
     }
 
+    if (max_lag) 
+    {
+        atomic_store(&reporting, 0);
+        pthread_join(reporter, NULL);
+        print_lags("final");
+    }
+
+    if (merged) 
+    {
+        out_buf_destroy(shared_out);
+    }
+
     return 0;
 }
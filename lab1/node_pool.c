@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "node_pool.h"
+
+#define CACHE_LINE_SIZE 64
+
+struct pool_cache;
+
+// Hidden header in front of each node
+struct pool_node {
+    struct pool_cache *owner;
+    struct pool_node *next;
+} __attribute__((aligned(16)));
+
+// Cache of one thread for one pool
+struct pool_cache {
+    struct pool_node *local;                // Only touched by the owner
+    node_pool_t *pool;
+    struct pool_cache *next_orphan;
+    struct pool_node *_Atomic remote __attribute__((aligned(CACHE_LINE_SIZE)));  // Freed by other threads
+};
+
+struct node_pool {
+    int id;
+    size_t stride;  // header + node, rounded to keep the nodes aligned
+    pthread_key_t key;              // Orphans the cache of an exiting thread
+    pthread_mutex_t mutex;          // Protects orphans
+    struct pool_cache *orphans;     // Caches of the exited threads
+};
+
+static int _Atomic nb_pools = 0;
+static _Thread_local struct pool_cache *caches[NODE_POOL_MAX_POOLS];
+
+// Destructor of the pool key: the nodes of the cache may still be in use, and
+// come back to its remote list, so the cache waits for a thread to adopt it
+static void orphan_cache(void *arg)
+{
+    struct pool_cache *cache = arg;
+    node_pool_t *pool = cache->pool;
+
+    caches[pool->id] = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    cache->next_orphan = pool->orphans;
+    pool->orphans = cache;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+node_pool_t *node_pool_create(size_t node_size)
+{
+    int id = atomic_fetch_add(&nb_pools, 1);
+    if (id >= NODE_POOL_MAX_POOLS)
+    {
+        fprintf(stderr, "node_pool: too many pools (max %d)\n", NODE_POOL_MAX_POOLS);
+        exit(1);
+    }
+
+    node_pool_t *pool = malloc(sizeof(*pool));
+    pool->id = id;
+    pool->stride = (sizeof(struct pool_node) + node_size + 15) & ~(size_t)15;
+    pthread_key_create(&pool->key, orphan_cache);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->orphans = NULL;
+    return pool;
+}
+
+static struct pool_cache *get_cache(node_pool_t *pool)
+{
+    struct pool_cache *cache = caches[pool->id];
+    if (cache == NULL)
+    {
+        // Adopt the cache of an exited thread first, with all its nodes
+        pthread_mutex_lock(&pool->mutex);
+        cache = pool->orphans;
+        if (cache != NULL)
+        {
+            pool->orphans = cache->next_orphan;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (cache == NULL)
+        {
+            cache = aligned_alloc(CACHE_LINE_SIZE, sizeof(*cache));
+            cache->local = NULL;
+            cache->pool = pool;
+            atomic_init(&cache->remote, NULL);
+        }
+        pthread_setspecific(pool->key, cache);
+        caches[pool->id] = cache;
+    }
+    return cache;
+}
+
+void *node_pool_alloc(node_pool_t *pool)
+{
+    struct pool_cache *cache = get_cache(pool);
+    struct pool_node *node = cache->local;
+
+    if (node == NULL)
+    {
+        // Take back, in one go, everything the other threads returned
+        node = atomic_exchange(&cache->remote, NULL);
+
+        if (node == NULL)
+        {
+            // Warm-up only: carve a new chunk of nodes
+            char *chunk = malloc(NODE_POOL_CHUNK * pool->stride);
+            for (int i = NODE_POOL_CHUNK - 1; i >= 0; i --)
+            {
+                struct pool_node *cur = (struct pool_node *)(chunk + i * pool->stride);
+                cur->owner = cache;
+                cur->next = node;
+                node = cur;
+            }
+        }
+    }
+
+    cache->local = node->next;
+    return node + 1;
+}
+
+void node_pool_free(node_pool_t *pool, void *ptr)
+{
+    struct pool_node *node = (struct pool_node *)ptr - 1;
+    struct pool_cache *owner = node->owner;
+
+    if (owner == caches[pool->id])
+    {
+        node->next = owner->local;
+        owner->local = node;
+    }
+    else
+    {
+        // Lock-free push: only the owner removes nodes, and it takes them all,
+        // so there is no ABA problem
+        struct pool_node *head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+        do
+        {
+            node->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, node,
+                                                        memory_order_release, memory_order_relaxed));
+    }
+}
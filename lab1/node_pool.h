@@ -0,0 +1,24 @@
+#ifndef _NODE_POOL_H_
+#define _NODE_POOL_H_
+
+#include <stddef.h>
+
+#define NODE_POOL_MAX_POOLS 8     // number of pools a program can create
+#define NODE_POOL_CHUNK     256   // nodes allocated at once when a cache is empty
+
+// Fixed-size node allocator with one cache per thread
+// A node always goes back to the cache of the thread that allocated it: a
+// local free is a simple push, a free from another thread is a lock-free
+// push on the owner's return list, which the owner takes back in one atomic
+// exchange when its local list is empty. In steady state, passing nodes from
+// producers to consumers never calls malloc nor free.
+// When a thread exits, its cache (and its nodes, including the ones other
+// threads still hold) is adopted by the next thread that needs a cache
+typedef struct node_pool node_pool_t;
+
+extern node_pool_t *node_pool_create(size_t node_size);
+
+extern void *node_pool_alloc(node_pool_t *pool);
+extern void node_pool_free(node_pool_t *pool, void *node);
+
+#endif
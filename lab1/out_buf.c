@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "out_buf.h"
+
+out_buf_t *out_buf_create(int fd, size_t size, bool shared)
+{
+    out_buf_t *out = malloc(sizeof(*out));
+
+    out->fd = fd;
+    out->mutex = NULL;
+    if (shared)
+    {
+        out->mutex = malloc(sizeof(*out->mutex));
+        pthread_mutex_init(out->mutex, NULL);
+    }
+    out->len = 0;
+    out->size = size;
+    out->data = malloc(size);
+
+    return out;
+}
+
+static void write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t res = write(fd, data, len);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("write");
+            return;
+        }
+        data += res;
+        len -= res;
+    }
+}
+
+static void flush_locked(out_buf_t *out)
+{
+    write_all(out->fd, out->data, out->len);
+    out->len = 0;
+}
+
+void out_buf_flush(out_buf_t *out)
+{
+    if (out->mutex)
+    {
+        pthread_mutex_lock(out->mutex);
+    }
+    flush_locked(out);
+    if (out->mutex)
+    {
+        pthread_mutex_unlock(out->mutex);
+    }
+}
+
+void out_buf_destroy(out_buf_t *out)
+{
+    out_buf_flush(out);
+    if (out->mutex)
+    {
+        pthread_mutex_destroy(out->mutex);
+        free(out->mutex);
+    }
+    free(out->data);
+    free(out);
+}
+
+void out_buf_printf(out_buf_t *out, const char *fmt, ...)
+{
+    char line[OUT_BUF_LINE];
+    va_list ap;
+
+    // Format before taking the buffer mutex (if any)
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+    {
+        return;
+    }
+    if (n >= sizeof(line))
+    {
+        n = sizeof(line) - 1;
+    }
+
+    if (out->mutex)
+    {
+        pthread_mutex_lock(out->mutex);
+    }
+    if (out->len + n > out->size)
+    {
+        flush_locked(out);
+    }
+    memcpy(out->data + out->len, line, n);
+    out->len += n;
+    if (out->mutex)
+    {
+        pthread_mutex_unlock(out->mutex);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef _OUT_BUF_H_
+#define _OUT_BUF_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define OUT_BUF_SIZE (64 * 1024)  // default size of an output buffer
+#define OUT_BUF_LINE 1024         // longest formatted line
+
+// Buffered writer: lines are formatted outside any queue lock and the buffer
+// is written with a single write when it is full or flushed
+// A private buffer belongs to one thread (one output stream per consumer),
+// a shared buffer merges the lines of several threads in one stream under its
+// own mutex, which is never the queue lock
+typedef struct {
+    int fd;
+    pthread_mutex_t *mutex;  // NULL for a private buffer
+    size_t len;
+    size_t size;
+    char *data;
+} out_buf_t;
+
+extern out_buf_t *out_buf_create(int fd, size_t size, bool shared);
+extern void out_buf_destroy(out_buf_t *out);  // flushes what is left
+
+extern void out_buf_printf(out_buf_t *out, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+extern void out_buf_flush(out_buf_t *out);
+
+#endif
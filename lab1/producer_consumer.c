@@ -3,8 +3,12 @@
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include "mpmc_ring.h"
+#include "line_reader.h"
+#include "node_pool.h"
 
 #define MAX_LINE_LENGTH 256
+#define RING_CAPACITY 1024  // number of lines buffered by the ring engine
 
 // Node structure for the linked-list queue
 typedef struct Node {
@@ -13,22 +17,53 @@ typedef struct Node {
 } Node;
 
 // Queue structure with a pointer to the first and last node
+// If ring is not NULL, the lock-free ring engine is used instead of the list
 typedef struct {
     Node *head;
     Node *tail;
+    mpmc_ring_t *ring;
 } Queue;
 
 // Shared queue and synchronization primitives
-Queue queue = {NULL, NULL};
+Queue queue = {NULL, NULL, NULL};
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+line_reader_t *reader = NULL;  // Only used by the zero-copy and batched ingestions
+int batch_size = 1;            // Maximum number of lines moved per lock acquisition
+
+// Nodes and lines come from per-thread pools: no malloc/free once warmed up
+node_pool_t *node_pool = NULL;
+node_pool_t *line_pool = NULL;
+
+// Copy a line (at most MAX_LINE_LENGTH - 1 chars) in a pooled buffer
+char* copy_line(const char *ptr, size_t len) 
+{
+    char *line = node_pool_alloc(line_pool);
+    if (len >= MAX_LINE_LENGTH) 
+    {
+        len = MAX_LINE_LENGTH - 1;
+    }
+    memcpy(line, ptr, len);
+    line[len] = '\0';
+    return line;
+}
+
+void free_line(char *line) 
+{
+    node_pool_free(line_pool, line);
+}
 
 // Enqueue function: adds a new line to the queue
 void enqueue(Queue *q, const char *line) 
 {
-    Node *new_node = (Node *)malloc(sizeof(Node));
-    new_node->line = strdup(line); // Copy the input line //动态分配内存来存储新复制的字符串，并将其返回 
-                                                            //自动为目标字符串分配所需的内存，不必手动计算长度和分配空间
+    if (q->ring != NULL) 
+    {
+        mpmc_ring_enqueue(q->ring, copy_line(line, strlen(line))); // The consumer frees the copy
+        return;
+    }
+
+    Node *new_node = (Node *)node_pool_alloc(node_pool);
+    new_node->line = copy_line(line, strlen(line)); // Copy the input line
     new_node->next = NULL;
 
     pthread_mutex_lock(&mutex);
@@ -52,6 +87,11 @@ void enqueue(Queue *q, const char *line)
 // Dequeue function: removes and returns the oldest line in the queue
 char* dequeue(Queue *q) 
 {
+    if (q->ring != NULL) 
+    {
+        return mpmc_ring_dequeue(q->ring); // No copy needed: the line is ours now
+    }
+
     pthread_mutex_lock(&mutex);
 
     // Wait if the queue is empty
@@ -61,7 +101,7 @@ char* dequeue(Queue *q)
     }
 
     Node *temp = q->head;
-    char *line = strdup(temp->line);  // Copy the line to return
+    char *line = temp->line;          // The line now belongs to the caller
     q->head = q->head->next;          // Move the head pointer
 
     // If the queue is now empty, reset the tail pointer
@@ -70,13 +110,107 @@ char* dequeue(Queue *q)
         q->tail = NULL;
     }
 
-    free(temp->line);  // Free the line memory
-    free(temp);        // Free the node
+    node_pool_free(node_pool, temp);  // Free the node
     pthread_mutex_unlock(&mutex);
 
     return line;
 }
 
+// Batched enqueue: takes ownership of n lines allocated with copy_line
+// The nodes are chained outside the lock, then linked with one acquisition
+// and one wakeup for the whole batch
+void enqueue_batch(Queue *q, char **lines, int n) 
+{
+    if (n == 0) 
+    {
+        return;
+    }
+
+    if (q->ring != NULL) 
+    {
+        mpmc_ring_enqueue_batch(q->ring, (void **)lines, n);
+        return;
+    }
+
+    Node *first = NULL, *last = NULL;
+    for (int i = 0; i < n; i ++) 
+    {
+        Node *new_node = (Node *)node_pool_alloc(node_pool);
+        new_node->line = lines[i];
+        new_node->next = NULL;
+        if (last == NULL) 
+        {
+            first = new_node;
+        } 
+        else 
+        {
+            last->next = new_node;
+        }
+        last = new_node;
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    if (q->tail == NULL) 
+    {
+        q->head = first;
+    } 
+    else 
+    {
+        q->tail->next = first;
+    }
+    q->tail = last;
+
+    // Several consumers may have work now
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+// Batched dequeue: waits for at least one line, then takes up to max lines
+// with the same lock acquisition. The caller owns (and frees) the lines
+int dequeue_batch(Queue *q, char **lines, int max) 
+{
+    if (q->ring != NULL) 
+    {
+        return mpmc_ring_dequeue_batch(q->ring, (void **)lines, max);
+    }
+
+    Node *nodes = NULL;
+    int n = 0;
+
+    pthread_mutex_lock(&mutex);
+
+    while (q->head == NULL) 
+    {
+        pthread_cond_wait(&cond, &mutex);
+    }
+
+    // Detach the first max nodes, the copies and frees are done outside the lock
+    nodes = q->head;
+    Node *last = nodes;
+    for (n = 1; n < max && last->next != NULL; n ++) 
+    {
+        last = last->next;
+    }
+    q->head = last->next;
+    if (q->head == NULL) 
+    {
+        q->tail = NULL;
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    for (int i = 0; i < n; i ++) 
+    {
+        Node *temp = nodes;
+        lines[i] = temp->line;  // No copy: the line now belongs to the caller
+        nodes = nodes->next;
+        node_pool_free(node_pool, temp);
+    }
+
+    return n;
+}
+
 // Consumer thread function
 void* consumer_function(void* arg) 
 {
@@ -85,7 +219,113 @@ void* consumer_function(void* arg)
         // Dequeue and print the line
         char *line = dequeue(&queue);
         printf("Consumed: %s", line);
-        free(line);  // Free the dequeued line
+        free_line(line);  // Free the dequeued line
+    }
+
+    pthread_exit(NULL);
+}
+
+// Producer thread function: read lines from standard input and enqueue them
+void* producer_function(void* arg) 
+{
+    char input[MAX_LINE_LENGTH];
+    while (fgets(input, MAX_LINE_LENGTH, stdin) != NULL) 
+    {
+        enqueue(&queue, input);
+    }
+
+    pthread_exit(NULL);
+}
+
+// Batched consumer: drain everything available (up to batch_size lines) at once
+void* consumer_batch_function(void* arg) 
+{
+    char *lines[batch_size];
+
+    while (1) 
+    {
+        int n = dequeue_batch(&queue, lines, batch_size);
+        for (int i = 0; i < n; i ++) 
+        {
+            printf("Consumed: %s", lines[i]);
+            free_line(lines[i]);
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+// Batched producer: the reader returns what a single read brings, so a burst
+// of input becomes a few large batches while an interactive input is not delayed
+void* producer_batch_function(void* arg) 
+{
+    char *lines[batch_size];
+    line_block_t *block;
+
+    while ((block = line_reader_next_block(reader)) != NULL) 
+    {
+        int n = 0;
+        for (size_t i = 0; i < block->nb_lines; i ++) 
+        {
+            // Like fgets, a long line is cut in pieces of MAX_LINE_LENGTH - 1 chars
+            const line_t *cur = &block->lines[i];
+            for (size_t off = 0; off < cur->len; off += MAX_LINE_LENGTH - 1) 
+            {
+                lines[n ++] = copy_line(cur->ptr + off, cur->len - off);
+                if (n == batch_size) 
+                {
+                    enqueue_batch(&queue, lines, n);
+                    n = 0;
+                }
+            }
+        }
+        enqueue_batch(&queue, lines, n);
+        line_block_release_all(block);  // Everything was copied
+    }
+
+    pthread_exit(NULL);
+}
+
+// Zero-copy consumer: the ring carries slices of the input blocks
+void* consumer_zero_copy_function(void* arg) 
+{
+    void *slices[batch_size];
+
+    while (1) 
+    {
+        size_t n = mpmc_ring_dequeue_batch(queue.ring, slices, batch_size);
+        for (size_t i = 0; i < n; i ++) 
+        {
+            line_t *line = slices[i];
+            printf("Consumed: %.*s", (int)line->len, line->ptr);
+            line_release(line);  // The block is freed with its last line
+        }
+    }
+
+    pthread_exit(NULL);
+}
+
+// Zero-copy producer: take a whole block of lines and enqueue the slices,
+// batch_size slices at a time
+void* producer_zero_copy_function(void* arg) 
+{
+    void *slices[batch_size];
+    line_block_t *block;
+
+    while ((block = line_reader_next_block(reader)) != NULL) 
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < block->nb_lines; i ++) 
+        {
+            slices[n ++] = &block->lines[i];
+            if (n == batch_size) 
+            {
+                mpmc_ring_enqueue_batch(queue.ring, slices, n);
+                n = 0;
+            }
+        }
+        mpmc_ring_enqueue_batch(queue.ring, slices, n);
+        line_block_release(block);
     }
 
     pthread_exit(NULL);
@@ -93,22 +333,101 @@ void* consumer_function(void* arg)
 
 int main(int argc, char** argv) 
 {
-    pthread_t consumer_thread;
+    if (argc > 6) 
+    {
+        fprintf(stderr, "Usage: %s [list|ring] [nb-producers] [nb-consumers] [copy|zero-copy] [batch-size]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Select the queue engine at startup (the linked list is the default)
+    const char *engine = argc > 1 ? argv[1] : "list";
+    int nb_producers = argc > 2 ? atoi(argv[2]) : 1;
+    int nb_consumers = argc > 3 ? atoi(argv[3]) : 1;
+    const char *ingestion = argc > 4 ? argv[4] : "copy";
+    batch_size = argc > 5 ? atoi(argv[5]) : 1;
+    void* (*producer)(void*) = producer_function;
+    void* (*consumer)(void*) = consumer_function;
+
+    node_pool = node_pool_create(sizeof(Node));
+    line_pool = node_pool_create(MAX_LINE_LENGTH);
 
-    // Start the consumer thread
-    if (pthread_create(&consumer_thread, NULL, consumer_function, NULL) != 0) {
-        perror("Failed to create consumer thread");
+    if (strcmp(engine, "ring") == 0) 
+    {
+        queue.ring = mpmc_ring_create(RING_CAPACITY);
+    } 
+    else if (strcmp(engine, "list") != 0) 
+    {
+        fprintf(stderr, "unknown queue engine: %s\n", engine);
         return EXIT_FAILURE;
     }
 
-    // Producer: Read lines from standard input and enqueue them
-    char input[MAX_LINE_LENGTH];
-    while (fgets(input, MAX_LINE_LENGTH, stdin) != NULL) {
-        enqueue(&queue, input);
+    // Zero-copy ingestion: no allocation nor copy per line, which needs a
+    // queue that carries the slices without allocating a node for each
+    if (strcmp(ingestion, "zero-copy") == 0) 
+    {
+        if (queue.ring == NULL) 
+        {
+            fprintf(stderr, "zero-copy ingestion requires the ring engine\n");
+            return EXIT_FAILURE;
+        }
+        reader = line_reader_open(STDIN_FILENO);
+        producer = producer_zero_copy_function;
+        consumer = consumer_zero_copy_function;
+    } 
+    else if (strcmp(ingestion, "copy") != 0) 
+    {
+        fprintf(stderr, "unknown ingestion mode: %s\n", ingestion);
+        return EXIT_FAILURE;
+    } 
+    else if (batch_size > 1) 
+    {
+        reader = line_reader_open(STDIN_FILENO);
+        producer = producer_batch_function;
+        consumer = consumer_batch_function;
     }
 
-    // Join the consumer thread (in a real program, you'd have a condition to stop)
-    pthread_join(consumer_thread, NULL);
+    if (batch_size < 1) 
+    {
+        fprintf(stderr, "invalid batch size: %d\n", batch_size);
+        return EXIT_FAILURE;
+    }
+    if (nb_producers < 1 || nb_consumers < 1) 
+    {
+        fprintf(stderr, "invalid number of producers or consumers: %d, %d\n", nb_producers, nb_consumers);
+        return EXIT_FAILURE;
+    }
+
+    pthread_t producer_threads[nb_producers];
+    pthread_t consumer_threads[nb_consumers];
+
+    // Start the consumer threads
+    for (int i = 0; i < nb_consumers; i ++) 
+    {
+        if (pthread_create(&consumer_threads[i], NULL, consumer, NULL) != 0) {
+            perror("Failed to create consumer thread");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Producers: fgets (or the reader) locks stdin, so each line goes to exactly one producer
+    for (int i = 0; i < nb_producers; i ++) 
+    {
+        if (pthread_create(&producer_threads[i], NULL, producer, NULL) != 0) {
+            perror("Failed to create producer thread");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < nb_producers; i ++) 
+    {
+        pthread_join(producer_threads[i], NULL);
+    }
+
+    // Join the consumer threads (in a real program, you'd have a condition to stop)
+    for (int i = 0; i < nb_consumers; i ++) 
+    {
+        pthread_join(consumer_threads[i], NULL);
+    }
 
     return 0;
 }
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include "mpmc_ring.h"
+#include "bcast_ring.h"
+#include "node_pool.h"
+
+#define RING_CAPACITY 1024  // same buffering for every engine
+#define MAX_BATCH 256
+
+// Latency histogram: 16 linear sub-buckets per power of two of nanoseconds,
+// so a percentile is known within 1/16 of its value
+#define SUB_BITS 4
+#define NB_BUCKETS (64 << SUB_BITS)
+
+// Synthetic message: the enqueue timestamp, then a line of msg_size bytes
+typedef struct {
+    uint64_t stamp;  // ns, CLOCK_MONOTONIC
+    uint64_t seq;
+    char line[];
+} Msg;
+
+// Engines under test:
+//   list:  linked list under one mutex (the producer_consumer.c list), bounded
+//          to RING_CAPACITY so that it buffers as much as the rings
+//   ring:  lock-free MPMC ring (mpmc_ring.c), each message to one consumer
+//   bcast: broadcast ring (bcast_ring.c), each message to every consumer,
+//          single producer only
+typedef enum { LIST, RING, BCAST } Engine;
+
+typedef struct Node {
+    Msg *msg;
+    struct Node *next;
+} Node;
+
+typedef struct {
+    Node *head;
+    Node *tail;
+    size_t len;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} List;
+
+// Per-consumer results, merged by main
+typedef struct {
+    uint64_t nb_msgs;
+    uint64_t hist[NB_BUCKETS];
+} __attribute__((aligned(CACHE_LINE_SIZE))) Stats;
+
+typedef struct {
+    int id;
+    Stats *stats;
+} ConsumerArg;
+
+Engine engine = RING;
+int nb_producers = 1;
+int nb_consumers = 1;
+size_t msg_size = 64;
+double duration = 1.0;
+int batch_size = 1;
+
+List list;
+mpmc_ring_t *ring = NULL;
+bcast_ring_t *bring = NULL;
+node_pool_t *msg_pool = NULL;
+node_pool_t *node_pool = NULL;
+char *template = NULL;     // The synthetic line copied into every message
+int _Atomic stop = 0;      // Set by main when the duration is over
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns)
+{
+    if (ns < (1 << SUB_BITS))
+    {
+        return ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    return ((msb - SUB_BITS + 1) << SUB_BITS) | ((ns >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+// Upper bound of the values falling in a bucket
+static uint64_t bucket_max(int b)
+{
+    if (b < (1 << SUB_BITS))
+    {
+        return b;
+    }
+    int msb = (b >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t low = ((uint64_t)1 << msb) | ((uint64_t)(b & ((1 << SUB_BITS) - 1)) << (msb - SUB_BITS));
+    return low + ((uint64_t)1 << (msb - SUB_BITS)) - 1;
+}
+
+static uint64_t percentile(const uint64_t *hist, uint64_t total, double p)
+{
+    uint64_t rank = (uint64_t)(p * total);
+    uint64_t seen = 0;
+    for (int b = 0; b < NB_BUCKETS; b ++)
+    {
+        seen += hist[b];
+        if (seen > rank)
+        {
+            return bucket_max(b);
+        }
+    }
+    return 0;
+}
+
+static void record(Stats *stats, const Msg *msg, uint64_t now)
+{
+    stats->hist[bucket_of(now - msg->stamp)] ++;
+    stats->nb_msgs ++;
+}
+
+// Generator: copy the synthetic line and stamp it as late as possible
+static void fill(Msg *msg, uint64_t seq)
+{
+    memcpy(msg->line, template, msg_size);
+    msg->seq = seq;
+    msg->stamp = now_ns();
+}
+
+static void list_enqueue_batch(Msg **msgs, int n)
+{
+    Node *first = NULL, *last = NULL;
+    for (int i = 0; i < n; i ++)
+    {
+        Node *node = node_pool_alloc(node_pool);
+        node->msg = msgs[i];
+        node->next = NULL;
+        if (last == NULL)
+        {
+            first = node;
+        }
+        else
+        {
+            last->next = node;
+        }
+        last = node;
+    }
+
+    pthread_mutex_lock(&list.mutex);
+    while (list.len + n > RING_CAPACITY)
+    {
+        pthread_cond_wait(&list.not_full, &list.mutex);
+    }
+    if (list.tail == NULL)
+    {
+        list.head = first;
+    }
+    else
+    {
+        list.tail->next = first;
+    }
+    list.tail = last;
+    list.len += n;
+    pthread_cond_broadcast(&list.not_empty);
+    pthread_mutex_unlock(&list.mutex);
+}
+
+static int list_dequeue_batch(Msg **msgs, int max)
+{
+    pthread_mutex_lock(&list.mutex);
+    while (list.head == NULL)
+    {
+        pthread_cond_wait(&list.not_empty, &list.mutex);
+    }
+    int n = 0;
+    while (n < max && list.head != NULL)
+    {
+        Node *node = list.head;
+        msgs[n ++] = node->msg;
+        list.head = node->next;
+        node_pool_free(node_pool, node);
+    }
+    if (list.head == NULL)
+    {
+        list.tail = NULL;
+    }
+    list.len -= n;
+    pthread_cond_broadcast(&list.not_full);
+    pthread_mutex_unlock(&list.mutex);
+    return n;
+}
+
+void* producer_function(void* arg)
+{
+    uint64_t seq = 0;
+    Msg *msgs[MAX_BATCH];
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed))
+    {
+        if (engine == BCAST)
+        {
+            // Messages are built in place in the ring entries
+            for (int i = 0; i < batch_size; i ++)
+            {
+                fill(bcast_ring_claim(bring), seq ++);
+            }
+            bcast_ring_publish(bring);
+            continue;
+        }
+
+        for (int i = 0; i < batch_size; i ++)
+        {
+            msgs[i] = node_pool_alloc(msg_pool);
+            fill(msgs[i], seq ++);
+        }
+        if (engine == RING)
+        {
+            mpmc_ring_enqueue_batch(ring, (void **)msgs, batch_size);
+        }
+        else
+        {
+            list_enqueue_batch(msgs, batch_size);
+        }
+    }
+    return NULL;
+}
+
+// The point-to-point engines stop on a NULL message, one per consumer
+void* consumer_function(void* arg)
+{
+    ConsumerArg *carg = arg;
+    Stats *stats = carg->stats;
+    Msg *msgs[MAX_BATCH];
+
+    while (1)
+    {
+        if (engine == BCAST)
+        {
+            size_t n = bcast_ring_wait(bring, carg->id);
+            if (n == 0)
+            {
+                break;
+            }
+            if (n > batch_size)
+            {
+                n = batch_size;
+            }
+            uint64_t now = now_ns();
+            for (size_t i = 0; i < n; i ++)
+            {
+                record(stats, bcast_ring_get(bring, carg->id, i), now);
+            }
+            bcast_ring_release_batch(bring, carg->id, n);
+            continue;
+        }
+
+        int n = engine == RING ? mpmc_ring_dequeue_batch(ring, (void **)msgs, batch_size)
+                               : list_dequeue_batch(msgs, batch_size);
+        uint64_t now = now_ns();
+        for (int i = 0; i < n; i ++)
+        {
+            if (msgs[i] == NULL)
+            {
+                // Only end markers follow ours: give back the ones of the
+                // other consumers
+                int extra = n - i - 1;
+                if (extra > 0 && engine == RING)
+                {
+                    mpmc_ring_enqueue_batch(ring, (void **)msgs + i + 1, extra);
+                }
+                else if (extra > 0)
+                {
+                    list_enqueue_batch(msgs + i + 1, extra);
+                }
+                return NULL;
+            }
+            record(stats, msgs[i], now);
+            node_pool_free(msg_pool, msgs[i]);
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-q list|ring|bcast] [-p producers] [-c consumers] "
+                    "[-s msg-size] [-d seconds] [-b batch-size] [-H]\n", prog);
+    fprintf(stderr, "  prints one CSV row per run, -H prints the header first\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    const char *engine_name = "ring";
+    bool header = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "q:p:c:s:d:b:H")) != -1)
+    {
+        switch (opt)
+        {
+        case 'q': engine_name = optarg; break;
+        case 'p': nb_producers = atoi(optarg); break;
+        case 'c': nb_consumers = atoi(optarg); break;
+        case 's': msg_size = atol(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'b': batch_size = atoi(optarg); break;
+        case 'H': header = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if (strcmp(engine_name, "list") == 0)
+    {
+        engine = LIST;
+    }
+    else if (strcmp(engine_name, "ring") == 0)
+    {
+        engine = RING;
+    }
+    else if (strcmp(engine_name, "bcast") == 0)
+    {
+        engine = BCAST;
+    }
+    else
+    {
+        usage(argv[0]);
+    }
+    if (nb_producers < 1 || nb_consumers < 1 || msg_size < 1 || duration <= 0 ||
+        batch_size < 1 || batch_size > MAX_BATCH)
+    {
+        usage(argv[0]);
+    }
+    if (engine == BCAST && nb_producers != 1)
+    {
+        fprintf(stderr, "the broadcast ring has a single producer\n");
+        return EXIT_FAILURE;
+    }
+
+    // A line of printable characters, like the ones the lab programs read
+    template = malloc(msg_size);
+    for (size_t i = 0; i < msg_size; i ++)
+    {
+        template[i] = 'a' + i % 26;
+    }
+    template[msg_size - 1] = '\n';
+
+    switch (engine)
+    {
+    case LIST:
+        list.head = list.tail = NULL;
+        list.len = 0;
+        pthread_mutex_init(&list.mutex, NULL);
+        pthread_cond_init(&list.not_empty, NULL);
+        pthread_cond_init(&list.not_full, NULL);
+        node_pool = node_pool_create(sizeof(Node));
+        msg_pool = node_pool_create(sizeof(Msg) + msg_size);
+        break;
+    case RING:
+        ring = mpmc_ring_create(RING_CAPACITY);
+        msg_pool = node_pool_create(sizeof(Msg) + msg_size);
+        break;
+    case BCAST:
+        bring = bcast_ring_create(RING_CAPACITY, sizeof(Msg) + msg_size, nb_consumers);
+        break;
+    }
+
+    pthread_t producers[nb_producers];
+    pthread_t consumers[nb_consumers];
+    ConsumerArg args[nb_consumers];
+    Stats *stats = aligned_alloc(CACHE_LINE_SIZE, nb_consumers * sizeof(Stats));
+    memset(stats, 0, nb_consumers * sizeof(Stats));
+
+    for (int i = 0; i < nb_consumers; i ++)
+    {
+        args[i].id = i;
+        args[i].stats = &stats[i];
+        pthread_create(&consumers[i], NULL, consumer_function, &args[i]);
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < nb_producers; i ++)
+    {
+        pthread_create(&producers[i], NULL, producer_function, NULL);
+    }
+
+    usleep(duration * 1000000);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < nb_producers; i ++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+
+    // Everything produced is drained before the consumers stop
+    if (engine == BCAST)
+    {
+        bcast_ring_close(bring);
+    }
+    for (int i = 0; i < nb_consumers && engine != BCAST; i ++)
+    {
+        Msg *end = NULL;
+        if (engine == RING)
+        {
+            mpmc_ring_enqueue(ring, end);
+        }
+        else
+        {
+            list_enqueue_batch(&end, 1);
+        }
+    }
+    for (int i = 0; i < nb_consumers; i ++)
+    {
+        pthread_join(consumers[i], NULL);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    // Merge the consumers' histograms
+    // With bcast, every delivery counts: a message read by c consumers counts c times
+    uint64_t *hist = calloc(NB_BUCKETS, sizeof(uint64_t));
+    uint64_t total = 0;
+    for (int i = 0; i < nb_consumers; i ++)
+    {
+        total += stats[i].nb_msgs;
+        for (int b = 0; b < NB_BUCKETS; b ++)
+        {
+            hist[b] += stats[i].hist[b];
+        }
+    }
+
+    if (header)
+    {
+        printf("engine,producers,consumers,msg_size,batch,seconds,messages,msgs_per_sec,p50_ns,p99_ns,p999_ns\n");
+    }
+    printf("%s,%d,%d,%zu,%d,%.3f,%" PRIu64 ",%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+           engine_name, nb_producers, nb_consumers, msg_size, batch_size, elapsed, total, total / elapsed,
+           percentile(hist, total, 0.50), percentile(hist, total, 0.99), percentile(hist, total, 0.999));
+
+    free(hist);
+    free(stats);
+    free(template);
+    if (ring != NULL)
+    {
+        mpmc_ring_destroy(ring);
+    }
+    if (bring != NULL)
+    {
+        bcast_ring_destroy(bring);
+    }
+    return 0;
+}
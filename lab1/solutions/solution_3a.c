@@ -3,6 +3,11 @@
 #include <string.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "../node_pool.h"
+#include "../line_reader.h"
 
 #define MAX_LENGTH 256
 #define xstr(s) str(s)
@@ -18,10 +23,64 @@ struct node {
 
 struct node* head = NULL;
 struct node* tail = NULL;
+int batch_size = 1;
+node_pool_t* pool; /* nodes are freed by the consumers, the pool sends them back to the producer */
+
+/* link the chain first...last (n nodes) with one lock and one wakeup */
+void enqueue_batch(struct node* first, struct node* last, int n) {
+  if(n == 0)
+    return;
+
+  last->next = NULL;
+
+  pthread_mutex_lock(&mutex);
+  if(tail)
+    tail->next = first;
+  else
+    head = first;
+  tail = last;
+  if(n == 1)
+    pthread_cond_signal(&cond);
+  else
+    pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+/* wait for at least one node, then detach up to max nodes in one go */
+struct node* dequeue_batch(int max) {
+  pthread_mutex_lock(&mutex);
+  while(head == NULL)
+    pthread_cond_wait(&cond, &mutex);
+
+  struct node* first = head;
+  struct node* last = head;
+  for(int i=1; i<max && last->next; i++)
+    last = last->next;
+
+  head = last->next;
+  if(!head)
+    tail = NULL;
+  last->next = NULL;
+  pthread_mutex_unlock(&mutex);
+
+  return first;
+}
 
 void* consumer(void* _arg) {
   int i = (int)(uintptr_t)_arg;
 
+  if(batch_size > 1) {
+    for(;;) {
+      struct node* n = dequeue_batch(batch_size);
+      while(n) {
+        struct node* next = n->next;
+        printf("[%d] Receive: %s\n", i, n->msg);
+        node_pool_free(pool, n);
+        n = next;
+      }
+    }
+  }
+
   for(;;) {
     pthread_mutex_lock(&mutex);
     while(head == NULL)
@@ -34,15 +93,75 @@ void* consumer(void* _arg) {
     pthread_mutex_unlock(&mutex);
 
     printf("[%d] Receive: %s\n", i, n->msg);
-    free(n);
+    node_pool_free(pool, n);
   }
 
   return 0;
 }
 
+/* the nodes are chained locally and handed to the consumers batch_size at a
+ * time; a block holds what a single read brought, so a partial batch is sent
+ * at the end of each block instead of waiting for more input */
+void producer_batch() {
+  line_reader_t* reader = line_reader_open(STDIN_FILENO);
+  line_block_t* block;
+  struct node* first = NULL;
+  struct node* last = NULL;
+  int n = 0;
+
+  while((block = line_reader_next_block(reader))) {
+    for(size_t l=0; l<block->nb_lines; l++) {
+      const char* p = block->lines[l].ptr;
+      const char* end = p + block->lines[l].len;
+
+      /* one message per word, like scanf("%s") */
+      for(;;) {
+        while(p < end && isspace((unsigned char)*p))
+          p++;
+        if(p == end)
+          break;
+        const char* word = p;
+        while(p < end && !isspace((unsigned char)*p))
+          p++;
+        size_t len = p - word < MAX_LENGTH - 1 ? p - word : MAX_LENGTH - 1;
+
+        struct node* cur = node_pool_alloc(pool);
+        memcpy(cur->msg, word, len);
+        cur->msg[len] = 0;
+
+        if(strncmp(cur->msg, "exit", MAX_LENGTH) == 0) {
+          enqueue_batch(first, last, n);
+          exit(0);
+        }
+
+        if(last)
+          last->next = cur;
+        else
+          first = cur;
+        last = cur;
+
+        if(++n == batch_size) {
+          enqueue_batch(first, last, n);
+          first = last = NULL;
+          n = 0;
+        }
+      }
+    }
+    line_block_release_all(block); /* every word was copied */
+
+    enqueue_batch(first, last, n);
+    first = last = NULL;
+    n = 0;
+  }
+  exit(0);
+}
+
 void producer() {
+  if(batch_size > 1)
+    producer_batch();
+
   for(;;) {
-    struct node* cur = malloc(sizeof(*cur));
+    struct node* cur = node_pool_alloc(pool);
 
     scanf("%"xstr(MAX_LENGTH)"s", cur->msg);
 
@@ -63,12 +182,15 @@ void producer() {
 }
 
 int main(int argc, char** argv) {
-  if(argc != 2) {
-    fprintf(stderr, "Usage: %s nb-threads\n", argv[0]);
+  if(argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: %s nb-threads [batch-size]\n", argv[0]);
     exit(1);
   }
 
   int n = atoi(argv[1]);
+  pool = node_pool_create(sizeof(struct node));
+  if(argc == 3)
+    batch_size = atoi(argv[2]);
   pthread_t tids[n];
 
   for(int i=0; i<n; i++)
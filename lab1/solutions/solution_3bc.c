@@ -5,7 +5,9 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <unistd.h>
+#include "../node_pool.h"
 
 #define MAX_LENGTH 256
 #define xstr(s) str(s)
@@ -24,8 +26,56 @@ struct thread_arg {
   size_t id;
 };
 
+/*
+ * Bounded lag: a consumer may not be more than max_lag messages (or bytes)
+ * behind the producer. When a consumer reaches the limit, the producer either
+ * waits for it (block), or cuts it from the list: new nodes do not count it
+ * anymore, so they are freed without it, and the laggard only has to release
+ * the nodes it still holds. A dropped laggard then exits, a skipping laggard
+ * asks to rejoin and restarts from the message the producer is writing.
+ */
+enum { LAG_BLOCK, LAG_DROP, LAG_SKIP };
+enum { ACTIVE, CUT, REJOIN, GONE };
+
+struct consumer_state {
+  size_t _Atomic consumed;        /* messages read, the producer computes the lag from it */
+  size_t _Atomic consumed_bytes;
+  size_t skipped;                 /* messages released without reading them */
+  int _Atomic state;
+  struct node* cut_at;            /* first node that does not count this consumer, set before CUT */
+  struct node* _Atomic rejoin;    /* node to restart from, set by the producer after REJOIN */
+} __attribute__((aligned(64)));
+
+size_t max_lag = 0;               /* 0: unbounded */
+bool lag_in_bytes = false;
+int lag_policy = LAG_BLOCK;
+
+size_t nb_consumers;
+struct consumer_state* states;    /* states[id - 1] belongs to consumer id */
+/* only counted with a lag bound, which needs a single producer */
+size_t produced = 0, produced_bytes = 0;
+bool _Atomic finished = false;    /* the producer has written "exit" */
+
+/*
+ * Several producers append to the same list without a global lock: the list
+ * always ends with an empty node, and a producer claims it by swapping in the
+ * new empty node it allocated. It then owns the claimed node until it fills
+ * it and links it to its own empty node. The order of the swaps is the order
+ * of the list, so each producer's messages stay in order.
+ * A consumer exits after one "exit" per producer.
+ */
+size_t nb_producers = 1;
+struct node* _Atomic tail;        /* the empty node at the end of the list */
+
+/* the producer sleeps here when it waits for a consumer (block policy) */
+pthread_mutex_t lag_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t lag_cond = PTHREAD_COND_INITIALIZER;
+int _Atomic producer_waiting = 0;
+
+node_pool_t* pool; /* the last reader frees a node, the pool sends it back to the producer */
+
 struct node* new_node(size_t n) {
-  struct node* node = malloc(sizeof(*node));
+  struct node* node = node_pool_alloc(pool);
   
   node->next = NULL;
   node->cpt = n;
@@ -44,15 +94,96 @@ struct thread_arg* new_arg(size_t id, struct node* fake) {
   return arg;
 }
 
+size_t lag_of(struct consumer_state* st) {
+  if(lag_in_bytes)
+    return produced_bytes - atomic_load(&st->consumed_bytes);
+  return produced - atomic_load(&st->consumed);
+}
+
+/* true if the consumer is behind and the next message would exceed its window */
+bool over_limit(struct consumer_state* st, size_t incoming) {
+  size_t lag = lag_of(st);
+  return max_lag && lag > 0 && lag + incoming > max_lag;
+}
+
+void wait_lag(struct consumer_state* st, size_t incoming) {
+  pthread_mutex_lock(&lag_mutex);
+  atomic_store(&producer_waiting, 1);
+  while(over_limit(st, incoming))
+    pthread_cond_wait(&lag_cond, &lag_mutex);
+  atomic_store(&producer_waiting, 0);
+  pthread_mutex_unlock(&lag_mutex);
+}
+
+/* release, without reading them, the nodes from cons up to stop (excluded)
+   returns the number of released nodes, seen_exit is set if one of them was "exit" */
+size_t release_until(struct node* cons, struct node* stop, bool* seen_exit) {
+  size_t n = 0;
+
+  while(cons != stop) {
+    pthread_mutex_lock(&cons->mutex);
+    while(cons->next == NULL)
+      pthread_cond_wait(&cons->cond, &cons->mutex);
+    struct node* tmp = cons->next;
+    if(strncmp(cons->msg, "exit", MAX_LENGTH) == 0)
+      *seen_exit = true;
+    bool last = --cons->cpt == 0;
+    pthread_mutex_unlock(&cons->mutex);
+    if(last)
+      node_pool_free(pool, cons);
+    cons = tmp;
+    n++;
+  }
+  return n;
+}
+
+/* called by a cut consumer: returns where to continue, NULL if it must exit */
+struct node* leave_list(size_t id, struct node* cons) {
+  struct consumer_state* st = &states[id - 1];
+  bool seen_exit = false;
+
+  st->skipped += release_until(cons, st->cut_at, &seen_exit);
+
+  if(lag_policy == LAG_DROP || seen_exit) {
+    atomic_store(&st->state, GONE);
+    printf("===== [%zu] dropped, %zu messages skipped ======\n", id, st->skipped);
+    return NULL;
+  }
+
+  atomic_store(&st->state, REJOIN);
+  for(;;) {
+    if((cons = atomic_exchange(&st->rejoin, NULL)))
+      break;
+    /* finished is set after the last rejoin: check rejoin once more */
+    if(atomic_load(&finished)) {
+      if((cons = atomic_exchange(&st->rejoin, NULL)))
+        break;
+      printf("===== [%zu] exiting, %zu messages skipped ======\n", id, st->skipped);
+      return NULL;
+    }
+    usleep(1000);
+  }
+  printf("===== [%zu] skipped to the head, %zu messages skipped ======\n", id, st->skipped);
+  return cons;
+}
+
 void* consumer(void* _arg) {
   struct thread_arg* arg = _arg;
   struct node* cons = arg->fake;
   size_t id = arg->id;
+  struct consumer_state* st = &states[id - 1];
+  size_t nb_exits = 0;
 
   free(arg);
 
   for(;;) {
     bool was_free = false;
+
+    if(atomic_load(&st->state) == CUT) {
+      if(!(cons = leave_list(id, cons)))
+        pthread_exit(NULL);
+      continue;
+    }
     
     pthread_mutex_lock(&cons->mutex);
     while(cons->next == NULL)
@@ -60,17 +191,26 @@ void* consumer(void* _arg) {
     char buf[MAX_LENGTH];
     strncpy(buf, cons->msg, MAX_LENGTH);
     struct node* tmp = cons->next;
-    if(--cons->cpt == 0) {
-      was_free = true;
-      free(cons);
-    }
+    was_free = --cons->cpt == 0;
     pthread_mutex_unlock(&cons->mutex);
+    if(was_free)
+      node_pool_free(pool, cons);
 
     cons = tmp;
 
+    atomic_fetch_add(&st->consumed_bytes, strlen(buf) + 1);
+    atomic_fetch_add(&st->consumed, 1);
+    if(atomic_load(&producer_waiting)) {
+      pthread_mutex_lock(&lag_mutex);
+      pthread_cond_signal(&lag_cond);
+      pthread_mutex_unlock(&lag_mutex);
+    }
+
     if(strncmp(buf, "exit", MAX_LENGTH) == 0) {
-      printf("===== [%zu] exiting ======\n", id);
-      pthread_exit(NULL);
+      if(++nb_exits == nb_producers) {
+        printf("===== [%zu] exiting ======\n", id);
+        pthread_exit(NULL);
+      }
     } else {
       printf("[%zu] receive: %s%s\n", id, buf, was_free ? " (free the node)" : "");
       // simulate different speeds, consummer i is faster than consummer i+1
@@ -79,10 +219,8 @@ void* consumer(void* _arg) {
   }
 }
 
-// here, the thread_arg is just here if we want to test with multiple producers
-void producer(struct thread_arg* _arg) {
+void* producer(void* _arg) {
   struct thread_arg* arg = _arg;
-  struct node* prod = arg->fake;
   size_t id = arg->id;
 
   free(arg);
@@ -102,39 +240,155 @@ void producer(struct thread_arg* _arg) {
     //char msg[MAX_LENGTH];
     //scanf("%"xstr(MAX_LENGTH)"s", msg);
     char* msg = poeme[i++];
-    
-    struct node* next = new_node(prod->cpt);
+    size_t incoming = lag_in_bytes ? strlen(msg) + 1 : 1;
+    bool cut[nb_consumers], rejoined[nb_consumers];
+    size_t count = 0, nb_rejoined = 0, nb_counted = 0;
+
+    for(size_t c=0; c<nb_consumers; c++) {
+      int state = atomic_load(&states[c].state);
+      if(state == ACTIVE || state == REJOIN)
+        nb_counted++;
+    }
+
+    /* count the consumers of the next node, cut or wait for the laggards */
+    for(size_t c=0; c<nb_consumers; c++) {
+      struct consumer_state* st = &states[c];
+      cut[c] = rejoined[c] = false;
+
+      switch(atomic_load(&st->state)) {
+      case ACTIVE:
+        if(over_limit(st, incoming)) {
+          /* never cut the last consumer, nobody would free the nodes */
+          if(lag_policy == LAG_BLOCK || nb_counted == 1) {
+            wait_lag(st, incoming);
+          } else {
+            cut[c] = true;
+            nb_counted--;
+            break;
+          }
+        }
+        count++;
+        break;
+      case REJOIN:
+        rejoined[c] = true;
+        nb_rejoined++;
+        count++;
+        break;
+      }
+    }
+
+    struct node* next = new_node(count);
+    struct node* prod = atomic_exchange(&tail, next); /* claim the empty node */
+
+    char lags[16 * nb_consumers + 1];
+    lags[0] = 0;
+    if(max_lag) {
+      size_t len = 0;
+      for(size_t c=0; c<nb_consumers; c++) {
+        if(cut[c] || atomic_load(&states[c].state) != ACTIVE)
+          len += snprintf(lags + len, sizeof(lags) - len, " -");
+        else
+          len += snprintf(lags + len, sizeof(lags) - len, " %zu", lag_of(&states[c]));
+      }
+    }
+
+    /* a cut consumer must see it before it can reach next */
+    for(size_t c=0; c<nb_consumers; c++) {
+      if(cut[c]) {
+        states[c].cut_at = next;
+        atomic_store(&states[c].state, CUT);
+      }
+    }
 
     pthread_mutex_lock(&prod->mutex);
-    printf("[%zu] produce: %s\n", id, msg);
+    printf("[%zu] produce: %s%s%s%s\n", id, msg, max_lag ? " (lags:" : "", lags, max_lag ? ")" : "");
+    prod->cpt += nb_rejoined; /* the rejoining consumers start with this message */
     prod->next = next;
     strncpy(prod->msg, msg, MAX_LENGTH);
     pthread_cond_broadcast(&prod->cond);
     pthread_mutex_unlock(&prod->mutex);
 
-    if(strncmp(msg, "exit", MAX_LENGTH) == 0)
-      return;
+    for(size_t c=0; c<nb_consumers; c++) {
+      struct consumer_state* st = &states[c];
+      if(rejoined[c]) {
+        atomic_store(&st->consumed, produced);
+        atomic_store(&st->consumed_bytes, produced_bytes);
+        atomic_store(&st->state, ACTIVE);
+        atomic_store(&st->rejoin, prod);
+      }
+    }
+
+    if(max_lag) {
+      produced++;
+      produced_bytes += strlen(msg) + 1;
+    }
 
-    prod = next;
+    if(strncmp(msg, "exit", MAX_LENGTH) == 0) {
+      atomic_store(&finished, true);
+      return NULL;
+    }
   }
 }
 
 int main(int argc, char** argv) {
-  if(argc != 2) {
-    fprintf(stderr, "Usage: %s nb-threads\n", argv[0]);
+  if(argc < 2 || argc > 5) {
+    fprintf(stderr, "Usage: %s nb-threads [nb-producers [max-lag[b] [block|drop|skip]]]\n", argv[0]);
     exit(1);
   }
 
   int n = atoi(argv[1]);
   pthread_t tids[n];
 
+  if(argc > 2)
+    nb_producers = atoi(argv[2]);
+  if(argc > 3) {
+    char* end;
+    max_lag = strtoul(argv[3], &end, 10);
+    lag_in_bytes = *end == 'b';
+  }
+  if(argc > 4) {
+    if(strcmp(argv[4], "drop") == 0)
+      lag_policy = LAG_DROP;
+    else if(strcmp(argv[4], "skip") == 0)
+      lag_policy = LAG_SKIP;
+    else if(strcmp(argv[4], "block") != 0) {
+      fprintf(stderr, "Unknown lag policy %s\n", argv[4]);
+      exit(1);
+    }
+  }
+  /* the lag counters and the cut/rejoin decisions belong to a single producer */
+  if(nb_producers < 1 || (max_lag && nb_producers > 1)) {
+    fprintf(stderr, "A bounded lag needs exactly one producer\n");
+    exit(1);
+  }
+  pthread_t ptids[nb_producers];
+
+  nb_consumers = n;
+  states = aligned_alloc(64, n * sizeof(*states));
+  for(int i=0; i<n; i++) {
+    atomic_init(&states[i].consumed, 0);
+    atomic_init(&states[i].consumed_bytes, 0);
+    states[i].skipped = 0;
+    atomic_init(&states[i].state, ACTIVE);
+    states[i].cut_at = NULL;
+    atomic_init(&states[i].rejoin, NULL);
+  }
+
+  pool = node_pool_create(sizeof(struct node));
   struct node* list = new_node(n);
-  
+  atomic_init(&tail, list);
+
   for(int i=0; i<n; i++)
     pthread_create(tids + i, NULL, consumer, new_arg(i + 1, list)); // 1...n are the consummers
 
-  producer(new_arg(0, list)); // 0 is the producer
-  
+  for(size_t i=1; i<nb_producers; i++)
+    pthread_create(ptids + i, NULL, producer, new_arg(n + i, NULL)); // n+1... are the other producers
+
+  producer(new_arg(0, list)); // 0 is the first producer
+
+  for(size_t i=1; i<nb_producers; i++)
+    pthread_join(ptids[i], NULL);
+
   for(int i=0; i<n; i++) {
     void* retval;
     pthread_join(tids[i], &retval);
@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../node_pool.h"
+
+#define MAX_LENGTH 256
+#define SPIN_TRIES 128
+#define xstr(s) str(s)
+#define str(s) #s
+
+#define asm_pause() asm volatile("pause")
+
+/*
+ * Same desynchronized list as solution_3bc.c, but a node only carries the
+ * payload, the next pointer and the number of readers left: no mutex and no
+ * condition per message. Consumers sleep on a single 32-bit publish sequence.
+ */
+struct node {
+  struct node* _Atomic next;
+  size_t _Atomic cpt;
+  char msg[MAX_LENGTH];
+};
+
+struct thread_arg {
+  struct node* fake;
+  size_t id;
+};
+
+uint32_t _Atomic seq = 0;         /* incremented by the producer at each message */
+uint32_t _Atomic nb_sleepers = 0; /* number of consumers in FUTEX_WAIT */
+
+long futex(void *addr1, int op, int val1, struct timespec *timeout,
+           void *addr2, int val3) {
+  return syscall(SYS_futex, addr1, op, val1, timeout, addr2, val3);
+}
+
+node_pool_t* pool; /* the last reader frees a node, the pool sends it back to the producer */
+
+struct node* new_node(size_t n) {
+  struct node* node = node_pool_alloc(pool);
+
+  atomic_init(&node->next, NULL);
+  atomic_init(&node->cpt, n);
+
+  return node;
+}
+
+struct thread_arg* new_arg(size_t id, struct node* fake) {
+  struct thread_arg* arg = malloc(sizeof(*arg));
+
+  arg->fake = fake;
+  arg->id = id;
+
+  return arg;
+}
+
+/* wait until the producer has filled cons, i.e., linked its successor */
+struct node* wait_next(struct node* cons) {
+  struct node* next;
+
+  for(int i=0; i<SPIN_TRIES; i++) {
+    if((next = atomic_load(&cons->next)))
+      return next;
+    asm_pause();
+  }
+
+  for(;;) {
+    uint32_t cur = atomic_load(&seq);
+    if((next = atomic_load(&cons->next)))
+      return next;
+    /* if the producer publishes after we read cur, seq != cur and FUTEX_WAIT returns at once */
+    atomic_fetch_add(&nb_sleepers, 1);
+    futex(&seq, FUTEX_WAIT_PRIVATE, cur, NULL, NULL, 0);
+    atomic_fetch_sub(&nb_sleepers, 1);
+  }
+}
+
+void* consumer(void* _arg) {
+  struct thread_arg* arg = _arg;
+  struct node* cons = arg->fake;
+  size_t id = arg->id;
+
+  free(arg);
+
+  for(;;) {
+    bool was_free = false;
+
+    struct node* tmp = wait_next(cons);
+    char buf[MAX_LENGTH];
+    size_t len = strnlen(cons->msg, MAX_LENGTH - 1);
+    memcpy(buf, cons->msg, len);
+    buf[len] = 0;
+    if(atomic_fetch_sub(&cons->cpt, 1) == 1) {
+      was_free = true;
+      node_pool_free(pool, cons);
+    }
+
+    cons = tmp;
+
+    if(strncmp(buf, "exit", MAX_LENGTH) == 0) {
+      printf("===== [%zu] exiting ======\n", id);
+      pthread_exit(NULL);
+    } else {
+      printf("[%zu] receive: %s%s\n", id, buf, was_free ? " (free the node)" : "");
+      // simulate different speeds, consummer i is faster than consummer i+1
+      //usleep((id-1)*100000);
+    }
+  }
+}
+
+// here, the thread_arg is just here if we want to test with multiple producers
+void producer(struct thread_arg* _arg) {
+  struct thread_arg* arg = _arg;
+  struct node* prod = arg->fake;
+  size_t id = arg->id;
+
+  free(arg);
+
+  char* poeme[] =
+    {
+      "Avec", "ses", "quatre", "dromadaires",
+      "Don", "Pedro", "d’Alfaroubeira",
+      "courut", "le", "monde", "et", "l’admira",
+      "il", "fit", "ce", "que", "je", "voudrais", "faire",
+      "si", "j’avais", "quatre", "dromadaires",
+      "exit"
+    };
+  size_t i = 0;
+
+  for(;;) {
+    char* msg = poeme[i++];
+
+    struct node* next = new_node(atomic_load(&prod->cpt));
+
+    printf("[%zu] produce: %s\n", id, msg);
+    size_t len = strnlen(msg, MAX_LENGTH - 1);
+    memcpy(prod->msg, msg, len);
+    prod->msg[len] = 0;
+    atomic_store(&prod->next, next); /* publishes msg */
+
+    atomic_fetch_add(&seq, 1);
+    if(atomic_load(&nb_sleepers))
+      futex(&seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+
+    if(strncmp(msg, "exit", MAX_LENGTH) == 0)
+      return;
+
+    prod = next;
+  }
+}
+
+int main(int argc, char** argv) {
+  if(argc != 2) {
+    fprintf(stderr, "Usage: %s nb-threads\n", argv[0]);
+    exit(1);
+  }
+
+  int n = atoi(argv[1]);
+  pthread_t tids[n];
+
+  pool = node_pool_create(sizeof(struct node));
+  struct node* list = new_node(n);
+
+  for(int i=0; i<n; i++)
+    pthread_create(tids + i, NULL, consumer, new_arg(i + 1, list)); // 1...n are the consummers
+
+  producer(new_arg(0, list)); // 0 is the producer
+
+  for(int i=0; i<n; i++) {
+    void* retval;
+    pthread_join(tids[i], &retval);
+  }
+
+  printf("Main quitting\n");
+
+  return 0;
+}
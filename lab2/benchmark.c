@@ -4,70 +4,86 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "solutions/tsc.h"
+
+// The lock algorithms, chosen by the last argument
+pthread_mutex_t mutex;
+atomic_int spin = 0;
+atomic_ulong ticket_next = 0;
+atomic_ulong ticket_owner = 0;
+
+void posix_lock() { pthread_mutex_lock(&mutex); }
+void posix_unlock() { pthread_mutex_unlock(&mutex); }
+
+void spin_lock() {
+    while (atomic_exchange(&spin, 1)) {
+        asm volatile("pause");
+    }
+}
+void spin_unlock() { atomic_store(&spin, 0); }
 
-pthread_mutex_t lock;
+void ticket_lock() {
+    unsigned long my = atomic_fetch_add(&ticket_next, 1);
+    while (atomic_load(&ticket_owner) != my) {
+        asm volatile("pause");
+    }
+}
+void ticket_unlock() { atomic_fetch_add(&ticket_owner, 1); }
 
-// Global variable to track total time spent in the critical section by all threads
-long long total_lock_time_ns = 0;  // in nanoseconds
+struct {
+    const char *name;
+    void (*lock)();
+    void (*unlock)();
+} algos[] = {
+    { "posix",    posix_lock,  posix_unlock },
+    { "spinlock", spin_lock,   spin_unlock },
+    { "ticket",   ticket_lock, ticket_unlock },
+};
 
-// Mutex to protect updates to the total_lock_time_ns variable
-pthread_mutex_t time_lock;
+void (*lock)();
+void (*unlock)();
 
 typedef struct {
     int tid;     // Thread id
     int iter;    // Number of iterations
-    int csd;     // Critical section delay in nanoseconds
-    int cd;    // Compute delay in nanoseconds
+    uint64_t csd;  // Critical section delay in TSC cycles
+    uint64_t cd;   // Compute delay in TSC cycles
+    uint64_t lock_time;  // Cycles spent acquiring the lock, summed by main after the join
 } thread_data_t;
 
-// Function to wait for a given time in nanoseconds
-void wait_ns(int ns) {
-    struct timespec start, current;
-    clock_gettime(CLOCK_MONOTONIC, &start);  // Record the start time
-
-    long int elapsed_ns = 0;
-    while (elapsed_ns < ns) {  // Loop until the desired time has passed
-        clock_gettime(CLOCK_MONOTONIC, &current);
-        elapsed_ns = (current.tv_sec - start.tv_sec) * 1e9 + (current.tv_nsec - start.tv_nsec);
+// Function to wait for a given number of TSC cycles (see tsc.h)
+void wait_cycles(uint64_t cycles) {
+    if (cycles) {
+        tsc_delay_until(tsc_now() + cycles);
     }
 }
 
 // Benchmark function executed by each thread
 void* benchmark(void* arg) {
     thread_data_t *data = (thread_data_t*) arg;
-    long long lock_time_ns = 0;
+    uint64_t lock_time = 0;
 
     for (int i = 0; i < data->iter; ++i) {
-        struct timespec lock_start, lock_end;
-
-        // Record the time before acquiring the lock
-        clock_gettime(CLOCK_MONOTONIC, &lock_start);
-
-        pthread_mutex_lock(&lock);
-
-        // Record the time after releasing the lock
-        clock_gettime(CLOCK_MONOTONIC, &lock_end);
+        // Time the acquisition of the lock
+        uint64_t lock_start = tsc_now();
 
-        // Calculate time spent in the critical section (locking time)
-        long long time_in_lock = (lock_end.tv_sec - lock_start.tv_sec) * 1e9 +
-                                 (lock_end.tv_nsec - lock_start.tv_nsec);
+        lock();
 
-        // Add to the per-thread lock time
-        lock_time_ns += time_in_lock;
+        lock_time += tsc_now() - lock_start;
 
         // Simulate the critical section delay
-        wait_ns(data->csd);
+        wait_cycles(data->csd);
 
-        pthread_mutex_unlock(&lock);
+        unlock();
 
         // Simulate the computation delay (outside the critical section)
-        wait_ns(data->cd);
+        wait_cycles(data->cd);
     }
 
-    // Protect total_lock_time_ns with a mutex and update the global time
-    pthread_mutex_lock(&time_lock);
-    total_lock_time_ns += lock_time_ns;
-    pthread_mutex_unlock(&time_lock);
+    // Only this thread writes its record, main reads it after the join
+    data->lock_time = lock_time;
 
     pthread_exit(NULL);
 }
@@ -83,23 +99,35 @@ int main(int argc, char **argv) {
     int it = atoi(argv[2]);     // Number of iterations per thread
     int csd = atoi(argv[3]);    // Critical section delay in nanoseconds
     int cd = atoi(argv[4]);   // Compute section delay in nanoseconds
-    char *lock_algo = argv[5];  // Lock algorithm (not used here but can be extended)
+    char *lock_algo = argv[5];  // Lock algorithm: posix, spinlock or ticket
 
     pthread_t threads[n];
     thread_data_t thread_data[n];
 
+    for (int i = 0; i < sizeof(algos) / sizeof(algos[0]); ++i) {
+        if (strcmp(lock_algo, algos[i].name) == 0) {
+            lock = algos[i].lock;
+            unlock = algos[i].unlock;
+        }
+    }
+    if (!lock) {
+        fprintf(stderr, "Unknown lock algorithm: %s\n", lock_algo);
+        return EXIT_FAILURE;
+    }
+
     // Initialize the mutex lock
-    pthread_mutex_init(&lock, NULL);
+    pthread_mutex_init(&mutex, NULL);
 
-    // Initialize the mutex for time calculation
-    pthread_mutex_init(&time_lock, NULL);
+    // Measure the TSC rate once, the delays are converted to cycles here
+    tsc_init();
 
     // Create threads
     for (int i = 0; i < n; ++i) {
         thread_data[i].tid = i;
         thread_data[i].iter = it;
-        thread_data[i].csd = csd;
-        thread_data[i].cd = cd;
+        thread_data[i].csd = tsc_from_ns(csd);
+        thread_data[i].cd = tsc_from_ns(cd);
+        thread_data[i].lock_time = 0;
 
         if (pthread_create(&threads[i], NULL, benchmark, (void*) &thread_data[i])) {
             fprintf(stderr, "Error creating thread %d\n", i);
@@ -115,6 +143,11 @@ int main(int argc, char **argv) {
         }
     }
 
+    long long total_lock_time_ns = 0;
+    for (int i = 0; i < n; ++i) {
+        total_lock_time_ns += tsc_to_ns(thread_data[i].lock_time);
+    }
+
     // Report the total and average time taken to acquire and release the lock
     long long average_lock_time_ns = total_lock_time_ns / (n * it);
 
@@ -122,8 +155,7 @@ int main(int argc, char **argv) {
     printf("Average time spent in acquiring and releasing the lock per operation: %lld ns\n", average_lock_time_ns);
 
     // Clean up
-    pthread_mutex_destroy(&lock);
-    pthread_mutex_destroy(&time_lock);
+    pthread_mutex_destroy(&mutex);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,51 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <hwloc.h>
+#include "cohortlock.h"
+
+static hwloc_topology_t topology;
+static int num_nodes = 0; /* 0: the topology is not loaded yet */
+
+static void init_topology() {
+  if(num_nodes)
+    return;
+  hwloc_topology_init(&topology);
+  hwloc_topology_load(topology);
+  num_nodes = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_NODE);
+  if(num_nodes < 1)
+    num_nodes = 1; /* no NUMA information: a single node */
+}
+
+int cohort_current_node() {
+  int cpu = sched_getcpu();
+  int depth = hwloc_get_type_depth(topology, HWLOC_OBJ_NODE);
+
+  for(int i=0; i<num_nodes && cpu >= 0; i++) {
+    hwloc_obj_t obj = hwloc_get_obj_by_depth(topology, depth, i);
+    if(obj && hwloc_bitmap_isset(obj->cpuset, cpu))
+      return i;
+  }
+  return 0;
+}
+
+void cohort_init(cohort_lock_t* lock, uint32_t max_handoffs) {
+  init_topology();
+
+  atomic_init(&lock->counter, 0);
+  atomic_init(&lock->screen, 0);
+  lock->max_handoffs = max_handoffs;
+  lock->nb_nodes = num_nodes;
+  lock->nodes = aligned_alloc(COHORT_ALIGN, num_nodes * sizeof(cohort_node_t));
+  for(int i=0; i<num_nodes; i++) {
+    atomic_init(&lock->nodes[i].counter, 0);
+    atomic_init(&lock->nodes[i].screen, 0);
+    lock->nodes[i].global_owned = false;
+    lock->nodes[i].nb_handoffs = 0;
+  }
+}
+
+void cohort_destroy(cohort_lock_t* lock) {
+  free(lock->nodes);
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef _COHORT_LOCK_H_
+#define _COHORT_LOCK_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define COHORT_ALIGN 64
+#define COHORT_MAX_HANDOFFS 64 /* default number of local handoffs before releasing the global lock */
+
+#ifndef asm_pause
+#define asm_pause() asm volatile("pause")
+#endif
+
+/*
+ *    Cohort lock (ticket/ticket): one ticket lock per NUMA node plus a global
+ *    ticket lock. The owner of the global lock passes it to the next waiter of
+ *    its own node, up to max_handoffs times in a row, so that the lock and the
+ *    data it protects stay in the same node instead of crossing the
+ *    interconnect at every release.
+ *    The node of a thread comes from cohort_current_node(), and a thread
+ *    must unlock with the node it locked with.
+ */
+typedef struct {
+  uint64_t _Atomic counter;
+  uint64_t _Atomic screen;
+  bool global_owned;       /* protected by the local lock: the global lock is inherited */
+  uint32_t nb_handoffs;    /* protected by the local lock */
+} __attribute__((aligned(COHORT_ALIGN))) cohort_node_t;
+
+typedef struct {
+  uint64_t _Atomic counter __attribute__((aligned(COHORT_ALIGN)));
+  uint64_t _Atomic screen;
+  uint32_t max_handoffs;
+  int nb_nodes;
+  cohort_node_t* nodes;
+} cohort_lock_t;
+
+extern void cohort_init(cohort_lock_t* lock, uint32_t max_handoffs);
+extern void cohort_destroy(cohort_lock_t* lock);
+
+/* NUMA node of the CPU the caller runs on (hwloc topology, loaded once) */
+extern int cohort_current_node();
+
+static inline void cohort_lock(cohort_lock_t* lock, int node) {
+  cohort_node_t* local = &lock->nodes[node];
+
+  uint64_t my = atomic_fetch_add(&local->counter, 1);
+  while(atomic_load(&local->screen) < my) { asm_pause(); }
+
+  if(local->global_owned)
+    return;
+
+  my = atomic_fetch_add(&lock->counter, 1);
+  while(atomic_load(&lock->screen) < my) { asm_pause(); }
+}
+
+static inline void cohort_unlock(cohort_lock_t* lock, int node) {
+  cohort_node_t* local = &lock->nodes[node];
+
+  /* someone of my node is waiting: give it the global lock with the local one */
+  if(atomic_load(&local->counter) - atomic_load_explicit(&local->screen, memory_order_relaxed) > 1 &&
+     local->nb_handoffs < lock->max_handoffs) {
+    local->nb_handoffs++;
+    local->global_owned = true;
+  } else {
+    local->nb_handoffs = 0;
+    local->global_owned = false;
+    atomic_fetch_add(&lock->screen, 1);
+  }
+  atomic_fetch_add(&local->screen, 1);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include "delegation.h"
+
+void deleg_init(deleg_lock_t* lock, uint32_t nb_slots) {
+  atomic_init(&lock->combiner, 0);
+  lock->nb_slots = nb_slots;
+  lock->slots = aligned_alloc(DELEG_ALIGN, nb_slots * sizeof(deleg_slot_t));
+  for(uint32_t i=0; i<nb_slots; i++) {
+    atomic_init(&lock->slots[i].fn, NULL);
+    lock->slots[i].arg = NULL;
+  }
+}
+
+void deleg_destroy(deleg_lock_t* lock) {
+  free(lock->slots);
+}
+
+/* run the pending requests of lock, returns how many */
+static uint32_t serve(deleg_lock_t* lock) {
+  uint32_t nb = 0;
+
+  for(uint32_t i=0; i<lock->nb_slots; i++) {
+    deleg_slot_t* slot = &lock->slots[i];
+    deleg_fn_t fn = atomic_load_explicit(&slot->fn, memory_order_acquire);
+    if(fn) {
+      fn(slot->arg);
+      atomic_store_explicit(&slot->fn, NULL, memory_order_release);
+      nb++;
+    }
+  }
+
+  return nb;
+}
+
+/*
+ * The combiner keeps the role while it finds requests, at most FC_PASSES
+ * scans so that it eventually goes back to its own work
+ */
+void fc_combine(deleg_lock_t* lock) {
+  for(int pass=0; pass<FC_PASSES && serve(lock); pass++)
+    ;
+  atomic_store(&lock->combiner, 0);
+}
+
+static void* rcl_server(void* arg) {
+  rcl_server_t* server = arg;
+
+  while(!atomic_load_explicit(&server->stop, memory_order_relaxed)) {
+    uint32_t nb = 0;
+    for(uint32_t i=0; i<server->nb_locks; i++)
+      nb += serve(&server->locks[i]);
+    if(!nb)
+      asm_pause();
+  }
+
+  return NULL;
+}
+
+void rcl_start(rcl_server_t* server, deleg_lock_t* locks, uint32_t nb_locks) {
+  atomic_init(&server->stop, 0);
+  server->locks = locks;
+  server->nb_locks = nb_locks;
+  pthread_create(&server->tid, NULL, rcl_server, server);
+}
+
+/* the clients must have been served: the server stops without a last scan */
+void rcl_stop(rcl_server_t* server) {
+  atomic_store(&server->stop, 1);
+  pthread_join(server->tid, NULL);
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef _DELEGATION_H_
+#define _DELEGATION_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define DELEG_ALIGN 64  /* every request slot on its own cache line */
+#define FC_PASSES   4   /* scans of the slots by a combiner before it gives up the role */
+
+#ifndef asm_pause
+#define asm_pause() asm volatile("pause")
+#endif
+
+/*
+ *    Delegation locks: instead of taking the lock and running its critical
+ *    section, a thread publishes the critical section as a closure in its own
+ *    request slot and waits until another thread has run it. The data
+ *    protected by the lock never leaves the cache of the thread that serves
+ *    the requests, only the slots move.
+ *
+ *    - flat combining (fc_execute): the first waiter that finds no combiner
+ *      becomes the combiner and runs the pending requests by batches
+ *    - remote core locking (rcl_execute): a dedicated server thread runs the
+ *      requests of a set of locks (rcl_start/rcl_stop), it spins and needs
+ *      a core of its own
+ *
+ *    A caller always uses the same slot, a slot is used by one caller at a
+ *    time. A delegation lock cannot be held: a critical section on two locks
+ *    is two requests.
+ */
+typedef void (*deleg_fn_t)(void* arg);
+
+typedef struct {
+  deleg_fn_t _Atomic fn;        /* pending request, NULL when served */
+  void* arg;
+} __attribute__((aligned(DELEG_ALIGN))) deleg_slot_t;
+
+typedef struct {
+  int _Atomic combiner __attribute__((aligned(DELEG_ALIGN))); /* fc: 1 while a thread combines */
+  uint32_t nb_slots;
+  deleg_slot_t* slots;
+} deleg_lock_t;
+
+typedef struct {
+  pthread_t tid;
+  int _Atomic stop;
+  deleg_lock_t* locks;
+  uint32_t nb_locks;
+} rcl_server_t;
+
+extern void deleg_init(deleg_lock_t* lock, uint32_t nb_slots);
+extern void deleg_destroy(deleg_lock_t* lock);
+
+extern void fc_combine(deleg_lock_t* lock);
+
+extern void rcl_start(rcl_server_t* server, deleg_lock_t* locks, uint32_t nb_locks);
+extern void rcl_stop(rcl_server_t* server);
+
+static inline void deleg_post(deleg_lock_t* lock, uint32_t slot, deleg_fn_t fn, void* arg) {
+  lock->slots[slot].arg = arg;
+  atomic_store_explicit(&lock->slots[slot].fn, fn, memory_order_release);
+}
+
+static inline bool deleg_served(deleg_lock_t* lock, uint32_t slot) {
+  return !atomic_load_explicit(&lock->slots[slot].fn, memory_order_acquire);
+}
+
+static inline void fc_execute(deleg_lock_t* lock, uint32_t slot, deleg_fn_t fn, void* arg) {
+  deleg_post(lock, slot, fn, arg);
+
+  while(!deleg_served(lock, slot)) {
+    if(!atomic_load_explicit(&lock->combiner, memory_order_relaxed) &&
+       !atomic_exchange(&lock->combiner, 1))
+      fc_combine(lock); /* serves our own request too */
+    else
+      asm_pause();
+  }
+}
+
+static inline void rcl_execute(deleg_lock_t* lock, uint32_t slot, deleg_fn_t fn, void* arg) {
+  deleg_post(lock, slot, fn, arg);
+
+  while(!deleg_served(lock, slot)) { asm_pause(); }
+}
+
+#endif
\ No newline at end of file
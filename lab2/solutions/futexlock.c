@@ -4,6 +4,7 @@
 #include <linux/futex.h>
 #include <time.h>
 #include <stdio.h>
+#include <limits.h>
 #include "futexlock.h"
 
 long futex(void *addr1, int op, int val1, struct timespec *timeout,
@@ -19,26 +20,88 @@ void futex_wake(void* addr, int nb_threads) {
   futex(addr, FUTEX_WAKE, nb_threads, NULL, NULL, 0);
 }
 
-void futex_lock(futex_lock_t* lock) {
-  uint64_t expected = FREE;
+/* the CAS FREE => BUSY_NO_WAITER of futex_lock failed */
+void futex_lock_slow(futex_lock_t* lock) {
+  for(;;) {
+    uint64_t expected = FREE;
+    if(atomic_compare_exchange_strong(&lock->state, &expected, BUSY_WITH_WAITERS)) /* take the lock and we don't know if we have waiters */
+      return;
 
-  if(!atomic_compare_exchange_strong(&lock->state, &expected, BUSY_NO_WAITER)) {
-  restart:
     if(expected == BUSY_WITH_WAITERS || atomic_compare_exchange_strong(&lock->state, &expected, BUSY_WITH_WAITERS))
       futex_wait(&lock->state, BUSY_WITH_WAITERS);
-    
-    expected = FREE;
-    if(!atomic_compare_exchange_strong(&lock->state, &expected, BUSY_WITH_WAITERS)) /* take the lock and we don't know if we have waiters */
-      goto restart;
   }
 }
 
-void futex_unlock(futex_lock_t* lock) {
-  uint64_t expected = BUSY_NO_WAITER;
+/* the CAS BUSY_NO_WAITER => FREE of futex_unlock failed: I have waiters */
+void futex_unlock_slow(futex_lock_t* lock) {
+  atomic_store(&lock->state, FREE);
+  futex_wake(&lock->state, 1);
+}
+
+/* the CAS FREE => BUSY_NO_WAITER of futex_lock_timed failed */
+bool futex_lock_timed_slow(futex_lock_t* lock, uint64_t timeout_ns) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t deadline = now.tv_sec*1000000000ull + now.tv_nsec + timeout_ns;
+
+  for(;;) {
+    uint64_t expected = FREE;
+    if(atomic_compare_exchange_strong(&lock->state, &expected, BUSY_WITH_WAITERS))
+      return true;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t cur = now.tv_sec*1000000000ull + now.tv_nsec;
+    if(cur >= deadline)
+      return false; /* we may leave BUSY_WITH_WAITERS behind: one useless wake up */
+
+    /* the timeout of FUTEX_WAIT is relative, measured on CLOCK_MONOTONIC */
+    struct timespec left = { (deadline - cur) / 1000000000, (deadline - cur) % 1000000000 };
+    if(expected == BUSY_WITH_WAITERS || atomic_compare_exchange_strong(&lock->state, &expected, BUSY_WITH_WAITERS))
+      futex(&lock->state, FUTEX_WAIT, BUSY_WITH_WAITERS, &left, NULL, 0);
+  }
+}
+
+void futex_fair_init(futex_fair_lock_t* lock) {
+  atomic_init(&lock->next, 0);
+  atomic_init(&lock->owner, 0);
+}
 
-  if(!atomic_compare_exchange_strong(&lock->state, &expected, FREE)) {
-    /* I have waiters */
-    atomic_store(&lock->state, FREE);
-    futex_wake(&lock->state, 1);
+/* sleep until owner is ticket, the wake ups for other bits do not concern us */
+void futex_fair_wait(futex_fair_lock_t* lock, uint32_t ticket) {
+  for(;;) {
+    uint32_t cur = atomic_load(&lock->owner);
+    if(cur == ticket)
+      return;
+    futex(&lock->owner, FUTEX_WAIT_BITSET, cur, NULL, NULL, 1u << (ticket % 32));
   }
+}
+
+void futex_fair_wake(futex_fair_lock_t* lock, uint32_t ticket) {
+  futex(&lock->owner, FUTEX_WAKE_BITSET, INT_MAX, NULL, NULL, 1u << (ticket % 32));
+}
+
+void futex_adaptive_init(futex_adaptive_lock_t* lock) {
+  atomic_init(&lock->base.state, FREE);
+  lock->nb_acquired = 0;
+  lock->acquired_at = 0;
+  lock->avg_hold = 0;
+  atomic_init(&lock->spin_budget, ADAPTIVE_MIN_SPIN);
+}
+
+/* the first CAS of futex_adaptive_lock failed: spin, then park */
+void futex_adaptive_lock_slow(futex_adaptive_lock_t* lock) {
+  uint64_t budget = atomic_load_explicit(&lock->spin_budget, memory_order_relaxed);
+  uint64_t start = __builtin_ia32_rdtsc();
+
+  do {
+    /* test before test-and-set: do not steal the line from the owner */
+    if(atomic_load_explicit(&lock->base.state, memory_order_relaxed) == FREE) {
+      uint64_t expected = FREE;
+      if(atomic_compare_exchange_strong(&lock->base.state, &expected, BUSY_NO_WAITER))
+        return;
+    }
+    asm volatile("pause");
+  } while(__builtin_ia32_rdtsc() - start < budget);
+
+  futex_lock_slow(&lock->base);
 }
\ No newline at end of file
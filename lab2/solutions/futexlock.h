@@ -16,7 +16,119 @@ typedef struct {
   uint64_t _Atomic state;
 } futex_lock_t;
 
-extern void futex_lock(futex_lock_t* lock);
-extern void futex_unlock(futex_lock_t* lock);
+extern void futex_wait(void* addr, int val);
+extern void futex_wake(void* addr, int nb_threads);
+
+extern void futex_lock_slow(futex_lock_t* lock);
+extern void futex_unlock_slow(futex_lock_t* lock);
+
+/* the uncontended paths are inlined in the caller, the syscalls stay in futexlock.c */
+static inline void futex_lock(futex_lock_t* lock) {
+  uint64_t expected = FREE;
+
+  if(!atomic_compare_exchange_strong(&lock->state, &expected, BUSY_NO_WAITER))
+    futex_lock_slow(lock);
+}
+
+static inline void futex_unlock(futex_lock_t* lock) {
+  uint64_t expected = BUSY_NO_WAITER;
+
+  if(!atomic_compare_exchange_strong(&lock->state, &expected, FREE))
+    futex_unlock_slow(lock);
+}
+
+/*
+ * Timed acquisition: gives up and returns false when the lock is not taken
+ * within timeout_ns nanoseconds (the deadline is checked after each wake up
+ * and bounds each FUTEX_WAIT)
+ */
+extern bool futex_lock_timed_slow(futex_lock_t* lock, uint64_t timeout_ns);
+
+static inline bool futex_lock_timed(futex_lock_t* lock, uint64_t timeout_ns) {
+  uint64_t expected = FREE;
+
+  return atomic_compare_exchange_strong(&lock->state, &expected, BUSY_NO_WAITER) ||
+    futex_lock_timed_slow(lock, timeout_ns);
+}
+
+/*
+ * Fair futex lock: futex_unlock frees the lock before waking a waiter, so a
+ * running thread can take it first and the woken waiter goes back to sleep.
+ * Here the lock is a ticket lock whose owner field is the futex word: the
+ * unlock hands the lock over to the next ticket, which nobody can take
+ * anymore, and only wakes that waiter (FUTEX_WAKE_BITSET on bit ticket % 32).
+ */
+typedef struct {
+  uint32_t _Atomic next;          /* next ticket to give */
+  uint32_t _Atomic owner;         /* ticket of the owner, the waiters sleep on it */
+} futex_fair_lock_t;
+
+extern void futex_fair_init(futex_fair_lock_t* lock);
+extern void futex_fair_wait(futex_fair_lock_t* lock, uint32_t ticket);
+extern void futex_fair_wake(futex_fair_lock_t* lock, uint32_t ticket);
+
+static inline void futex_fair_lock(futex_fair_lock_t* lock) {
+  uint32_t ticket = atomic_fetch_add(&lock->next, 1);
+
+  if(atomic_load(&lock->owner) != ticket)
+    futex_fair_wait(lock, ticket);
+}
+
+static inline void futex_fair_unlock(futex_fair_lock_t* lock) {
+  uint32_t ticket = atomic_fetch_add(&lock->owner, 1) + 1;
+
+  /* a thread that takes its ticket after the add finds the lock already its own */
+  if(atomic_load(&lock->next) != ticket)
+    futex_fair_wake(lock, ticket);
+}
+
+/*
+ * Adaptive futex lock: a contended acquisition first spins for spin_budget
+ * cycles, then parks like futex_lock. The owner measures how long it holds
+ * the lock (one acquisition out of ADAPTIVE_SAMPLE, reading the TSC is not
+ * free) and keeps the budget at twice the recent average hold time, so
+ * short critical sections never pay the syscalls while long ones stop
+ * spinning. The budget is capped at about the cost of parking and waking up.
+ */
+#define ADAPTIVE_MIN_SPIN 128     /* cycles */
+#define ADAPTIVE_MAX_SPIN 16384   /* cycles, ~ two syscalls and a context switch */
+#define ADAPTIVE_SAMPLE   8       /* power of two */
+
+typedef struct {
+  futex_lock_t base;
+  uint64_t nb_acquired;           /* protected by the lock */
+  uint64_t acquired_at;           /* protected by the lock, 0 if not sampled */
+  uint64_t avg_hold;              /* protected by the lock, in cycles */
+  uint64_t _Atomic spin_budget;   /* read by the spinners */
+} futex_adaptive_lock_t;
+
+extern void futex_adaptive_init(futex_adaptive_lock_t* lock);
+extern void futex_adaptive_lock_slow(futex_adaptive_lock_t* lock);
+
+static inline void futex_adaptive_lock(futex_adaptive_lock_t* lock) {
+  uint64_t expected = FREE;
+
+  if(!atomic_compare_exchange_strong(&lock->base.state, &expected, BUSY_NO_WAITER))
+    futex_adaptive_lock_slow(lock);
+  lock->acquired_at = ++lock->nb_acquired % ADAPTIVE_SAMPLE ? 0 : __builtin_ia32_rdtsc();
+}
+
+static inline void futex_adaptive_unlock(futex_adaptive_lock_t* lock) {
+  if(lock->acquired_at) {
+    uint64_t hold = __builtin_ia32_rdtsc() - lock->acquired_at;
+
+    /* moving average over the last ~8 samples */
+    lock->avg_hold += ((int64_t)hold - (int64_t)lock->avg_hold) / 8;
+
+    uint64_t budget = 2 * lock->avg_hold;
+    if(budget < ADAPTIVE_MIN_SPIN)
+      budget = ADAPTIVE_MIN_SPIN;
+    else if(budget > ADAPTIVE_MAX_SPIN)
+      budget = ADAPTIVE_MAX_SPIN;
+    atomic_store_explicit(&lock->spin_budget, budget, memory_order_relaxed);
+  }
+
+  futex_unlock(&lock->base);
+}
 
 #endif
\ No newline at end of file
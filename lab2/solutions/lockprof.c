@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+/*
+ *    Lock profiler: LD_PRELOAD=liblockprof.so program args...
+ *
+ *    Interposes pthread_mutex_lock/unlock and pthread_cond_wait, and counts
+ *    for each call site (the return address of the call to pthread_mutex_lock
+ *    or pthread_cond_wait): the acquisitions, the contended ones (the trylock
+ *    failed), the time spent waiting for the lock and the time it was held.
+ *    The sites are sorted by wait time and dumped on stderr at exit, as
+ *    object+offset so that addr2line -f -e object offset finds the line.
+ *
+ *    The times are TSC cycles, converted with the rate measured between the
+ *    load of the library and the report: no calibration at startup.
+ */
+#define MAX_SITES 4096          /* power of two */
+#define MAX_HELD  32            /* locks held at once by a thread */
+#define REPORT_LINES 20
+
+struct site {
+  void* _Atomic addr;           /* NULL: free entry */
+  uint64_t _Atomic nb_acquired;
+  uint64_t _Atomic nb_contended;
+  uint64_t _Atomic nb_cond_waits;
+  uint64_t _Atomic wait;        /* cycles */
+  uint64_t _Atomic hold;        /* cycles */
+};
+
+struct held {
+  pthread_mutex_t* mutex;
+  struct site* site;
+  uint64_t since;
+};
+
+static struct site sites[MAX_SITES];
+static int _Atomic nb_lost = 0; /* the table is full */
+
+static _Thread_local struct held held[MAX_HELD];
+static _Thread_local int nb_held = 0;
+
+static int (*real_lock)(pthread_mutex_t*);
+static int (*real_trylock)(pthread_mutex_t*);
+static int (*real_unlock)(pthread_mutex_t*);
+static int (*real_cond_wait)(pthread_cond_t*, pthread_mutex_t*);
+
+static uint64_t start_cycles;
+static struct timespec start_time;
+
+static inline uint64_t now() {
+  return __builtin_ia32_rdtsc();
+}
+
+static void resolve() {
+  real_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+  real_trylock = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+  real_unlock = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+  /* the unversioned symbol is the old LinuxThreads condition */
+  real_cond_wait = dlvsym(RTLD_NEXT, "pthread_cond_wait", "GLIBC_2.3.2");
+  if(!real_cond_wait)
+    real_cond_wait = dlsym(RTLD_NEXT, "pthread_cond_wait");
+}
+
+/* lock-free insertion: an entry is never removed, its key never changes */
+static struct site* find_site(void* addr) {
+  uintptr_t h = ((uintptr_t)addr >> 2) * 0x9e3779b97f4a7c15ull;
+
+  for(int i=0; i<MAX_SITES; i++) {
+    struct site* site = &sites[(h + i) & (MAX_SITES - 1)];
+    void* cur = atomic_load_explicit(&site->addr, memory_order_relaxed);
+    if(cur == addr)
+      return site;
+    if(!cur) {
+      if(atomic_compare_exchange_strong(&site->addr, &cur, addr) || cur == addr)
+        return site;
+    }
+  }
+  atomic_fetch_add(&nb_lost, 1);
+  return NULL;
+}
+
+static inline void count(uint64_t _Atomic* counter, uint64_t val) {
+  atomic_fetch_add_explicit(counter, val, memory_order_relaxed);
+}
+
+static void push_held(pthread_mutex_t* mutex, struct site* site) {
+  if(site && nb_held < MAX_HELD)
+    held[nb_held++] = (struct held){ mutex, site, now() };
+}
+
+/* the last acquisition of mutex by this thread is over */
+static void pop_held(pthread_mutex_t* mutex) {
+  for(int i=nb_held-1; i>=0; i--)
+    if(held[i].mutex == mutex) {
+      count(&held[i].site->hold, now() - held[i].since);
+      held[i] = held[--nb_held];
+      return;
+    }
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+  if(!real_lock)
+    resolve();
+
+  struct site* site = find_site(__builtin_return_address(0));
+  int res = real_trylock(mutex);
+
+  if(res == EBUSY) {
+    uint64_t start = now();
+    res = real_lock(mutex);
+    if(site) {
+      count(&site->wait, now() - start);
+      count(&site->nb_contended, 1);
+    }
+  }
+
+  if(res == 0) {
+    if(site)
+      count(&site->nb_acquired, 1);
+    push_held(mutex, site);
+  }
+  return res;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex) {
+  if(!real_unlock)
+    resolve();
+
+  pop_held(mutex);
+  return real_unlock(mutex);
+}
+
+/* the mutex is released during the wait: two holds, the second one from here */
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+  if(!real_cond_wait)
+    resolve();
+
+  struct site* site = find_site(__builtin_return_address(0));
+  pop_held(mutex);
+  int res = real_cond_wait(cond, mutex);
+  if(site)
+    count(&site->nb_cond_waits, 1);
+  push_held(mutex, site);
+  return res;
+}
+
+__attribute__((constructor)) static void lockprof_init() {
+  resolve();
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  start_cycles = now();
+}
+
+static int cmp_sites(const void* a, const void* b) {
+  const struct site* x = *(struct site* const*)a;
+  const struct site* y = *(struct site* const*)b;
+  if(x->wait != y->wait)
+    return x->wait < y->wait ? 1 : -1;
+  return x->nb_acquired < y->nb_acquired ? 1 : x->nb_acquired > y->nb_acquired ? -1 : 0;
+}
+
+static void print_site(struct site* site, double ns_per_cycle) {
+  Dl_info info;
+  char where[256];
+
+  if(dladdr(site->addr, &info) && info.dli_fname) {
+    if(info.dli_sname)
+      snprintf(where, sizeof(where), "%s+0x%lx (%s)", info.dli_fname,
+               (uintptr_t)site->addr - (uintptr_t)info.dli_fbase, info.dli_sname);
+    else
+      snprintf(where, sizeof(where), "%s+0x%lx", info.dli_fname,
+               (uintptr_t)site->addr - (uintptr_t)info.dli_fbase);
+  } else
+    snprintf(where, sizeof(where), "%p", site->addr);
+
+  uint64_t nb = site->nb_acquired + site->nb_cond_waits;
+  fprintf(stderr, "%12lu %9.1lf%% %14.0lf %10.0lf %14.0lf %10.0lf %8lu  %s\n",
+          site->nb_acquired, site->nb_acquired ? 100.0 * site->nb_contended / site->nb_acquired : 0.0,
+          site->wait * ns_per_cycle, site->nb_contended ? site->wait * ns_per_cycle / site->nb_contended : 0.0,
+          site->hold * ns_per_cycle, nb ? site->hold * ns_per_cycle / nb : 0.0,
+          site->nb_cond_waits, where);
+}
+
+__attribute__((destructor)) static void lockprof_report() {
+  struct timespec end_time;
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  uint64_t cycles = now() - start_cycles;
+  double ns = (end_time.tv_sec - start_time.tv_sec) * 1e9 + (end_time.tv_nsec - start_time.tv_nsec);
+  double ns_per_cycle = cycles ? ns / cycles : 0;
+
+  static struct site* sorted[MAX_SITES];
+  int nb = 0;
+  for(int i=0; i<MAX_SITES; i++)
+    if(atomic_load(&sites[i].addr))
+      sorted[nb++] = &sites[i];
+  qsort(sorted, nb, sizeof(*sorted), cmp_sites);
+
+  fprintf(stderr, "=== lockprof: %d call sites, by wait time (times in ns) ===\n", nb);
+  fprintf(stderr, "%12s %10s %14s %10s %14s %10s %8s  %s\n",
+          "acquired", "contended", "wait", "avg-wait", "hold", "avg-hold", "cond", "site");
+  for(int i=0; i<nb && i<REPORT_LINES; i++)
+    print_site(sorted[i], ns_per_cycle);
+  if(nb > REPORT_LINES)
+    fprintf(stderr, "(%d more sites)\n", nb - REPORT_LINES);
+  if(nb_lost)
+    fprintf(stderr, "(%d acquisitions lost: more than %d sites)\n", nb_lost, MAX_SITES);
+}
\ No newline at end of file
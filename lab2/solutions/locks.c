@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -5,200 +6,1162 @@
 #include <pthread.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
 #include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <hwloc.h>
 #include "futexlock.h"
+#include "rwlock.h"
+#include "queuelock.h"
+#include "cohortlock.h"
+#include "delegation.h"
+#include "tsc.h"
+#include "rcu.h"
 
 #define asm_pause() asm volatile("pause")
+#define always_inline inline __attribute__((always_inline))
 
-uint32_t z = 0;
+/*
+ * Layout: every lock, every z[k] and every per-thread record has its own
+ * cache line, so the only false sharing is the one of the algorithms. The
+ * lock types of the headers stay compact, the benchmark wraps them in
+ * padded() below
+ */
+#define CACHE_LINE 64
+#define padded(type) struct { type v; } __attribute__((aligned(CACHE_LINE)))
+
+/*
+ * Multi-lock mode: every algorithm has nb_locks independent locks, lock k
+ * protects z[k]. With more than one lock, each iteration holds two of them at
+ * once (taken in index order)
+ */
+#define MAX_LOCKS 64
+
+padded(uint32_t) z[MAX_LOCKS];
+uint32_t nb_locks = 1;
+
+/*
+ * Shared data (-c): the critical section of lock k also increments
+ * nb_lines cache lines protected by k (a read only loads them), so the cost
+ * of moving the protected data along with the lock adds to the handover
+ */
+uint32_t nb_lines = 0;
+padded(uint64_t)* data[MAX_LOCKS];
+
+/*
+ * Pointer swap (-P): lock k also protects ptr[k], a read dereferences it and
+ * a write replaces it with an updated copy, then frees the old copy at once
+ * or, for the algos whose readers take no lock (rcu), after a grace period
+ */
+struct payload {
+  uint64_t v;
+  struct rcu_head rcu;
+};
+
+bool swap = false;
+bool deferred_free = false;     /* set by run() from the algo */
+padded(struct payload* _Atomic) ptr[MAX_LOCKS];
+
+/*
+ * Read ratio: read_pct% of the iterations only read z with a read lock.
+ * The exclusive locks use their normal lock for reads
+ */
+uint32_t read_pct = 0;
 
 uint32_t n;
 uint32_t it;
 uint32_t csd;
 uint32_t cd;
-
-void (*ze_lock)();
-void (*ze_unlock)();
+uint64_t csd_cycles;            /* csd and cd converted once by run() */
+uint64_t cd_cycles;
 
 /*
  *    spin lock
  */
-int slock = 0;
+padded(int) slock[MAX_LOCKS];
+
+static always_inline void spin_lock(uint32_t k) {
+  while(atomic_exchange(&slock[k].v, 1)) { asm_pause(); }
+}
 
-void spin_lock() {
-  while(atomic_exchange(&slock, 1)) { asm_pause(); }
+static always_inline void spin_unlock(uint32_t k) {
+  atomic_store(&slock[k].v, 0);
 }
 
-void spin_unlock() {
-  atomic_store(&slock, 0);
+/*
+ *    test-and-test-and-set lock with capped exponential backoff: the waiters
+ *    only read the lock word, and a thread that loses the exchange waits
+ *    twice as long before trying again (same word and unlock as spin_lock)
+ */
+#define BACKOFF_MIN 4           /* pauses */
+#define BACKOFF_MAX 1024        /* pauses */
+
+static always_inline void ttas_lock(uint32_t k) {
+  uint32_t backoff = BACKOFF_MIN;
+
+  for(;;) {
+    while(atomic_load_explicit(&slock[k].v, memory_order_relaxed)) { asm_pause(); }
+    if(!atomic_exchange(&slock[k].v, 1))
+      return;
+    for(uint32_t i=0; i<backoff; i++)
+      asm_pause();
+    if(backoff < BACKOFF_MAX)
+      backoff <<= 1;
+  }
 }
 
 /*
  *    tocket lock
  */
 struct {
-  uint64_t _Atomic counter;
-  uint64_t _Atomic screen;
-} ticket = { 0, 0 };
+  uint64_t _Atomic counter __attribute__((aligned(CACHE_LINE))); /* taken by the arriving threads */
+  uint64_t _Atomic screen __attribute__((aligned(CACHE_LINE)));  /* polled by the waiters */
+} ticket[MAX_LOCKS];
 
-void ticket_lock() {
-  uint64_t my = atomic_fetch_add(&ticket.counter, 1);
-  while(atomic_load(&ticket.screen) < my) { asm_pause(); }
+static always_inline void ticket_lock(uint32_t k) {
+  uint64_t my = atomic_fetch_add(&ticket[k].counter, 1);
+  while(atomic_load(&ticket[k].screen) < my) { asm_pause(); }
 }
 
-void ticket_unlock() {
-  atomic_fetch_add(&ticket.screen, 1);
+static always_inline void ticket_unlock(uint32_t k) {
+  atomic_fetch_add(&ticket[k].screen, 1);
 }
 
 /*
- *    MCS lock
+ *    ticket lock with proportional backoff: a waiter that is d places from
+ *    the lock does not poll screen before about d critical sections
  */
-struct node { struct node* _Atomic next; bool _Atomic is_free; };
-_Thread_local struct node my;
-struct node* _Atomic lock = NULL;
+#define TICKET_BACKOFF 32       /* pauses per waiter ahead */
 
-void mcs_lock() {
-  my.next = NULL;
-  my.is_free = false;
-  
-  struct node* p = atomic_exchange(&lock, &my);
-  if(p) {
-    atomic_store(&p->next, &my);
-    while(!atomic_load(&my.is_free)) { asm_pause(); }
+static always_inline void ticket_pb_lock(uint32_t k) {
+  uint64_t my = atomic_fetch_add(&ticket[k].counter, 1);
+  uint64_t cur;
+
+  while((cur = atomic_load(&ticket[k].screen)) < my) {
+    for(uint64_t i=0; i<(my - cur) * TICKET_BACKOFF; i++)
+      asm_pause();
   }
 }
 
-void mcs_unlock() {
-  struct node* expected = &my;
-  if(!atomic_load(&my.next) && 
-     atomic_compare_exchange_strong(&lock, &expected, NULL))
+/*
+ *    MCS lock (queuelock.h): one queue node per thread and per lock
+ */
+padded(mcs_lock_t) mcs[MAX_LOCKS];
+_Thread_local mcs_node_t my_mcs[MAX_LOCKS];
+
+static always_inline void test_mcs_lock(uint32_t k) { mcs_lock(&mcs[k].v, &my_mcs[k]); }
+static always_inline void test_mcs_unlock(uint32_t k) { mcs_unlock(&mcs[k].v, &my_mcs[k]); }
+
+/*
+ *    CLH lock (queuelock.h): the nodes move from thread to thread, each thread
+ *    keeps the one it got back for the next acquisition of the same lock, and
+ *    frees the ones it ends with (no one else points to them) when it is done
+ */
+padded(clh_lock_t) clh[MAX_LOCKS];
+_Thread_local clh_node_t* my_clh[MAX_LOCKS];
+
+static always_inline void test_clh_lock(uint32_t k) {
+  if(!my_clh[k])
+    my_clh[k] = clh_node_alloc();
+  clh_lock(&clh[k].v, my_clh[k]);
+}
+
+static always_inline void test_clh_unlock(uint32_t k) { clh_unlock(&clh[k].v, &my_clh[k]); }
+
+static void clh_free_nodes() {
+  for(int k=0; k<MAX_LOCKS; k++) {
+    free(my_clh[k]);
+    my_clh[k] = NULL;
+  }
+}
+
+/*
+ *    NUMA cohort lock (cohortlock.h): a thread keeps the node it found at its
+ *    first acquisition, which is only a hint when threads are not pinned (-p)
+ */
+cohort_lock_t cohort[MAX_LOCKS];
+_Thread_local int my_node = -1;
+
+static always_inline void test_cohort_lock(uint32_t k) {
+  if(my_node < 0)
+    my_node = cohort_current_node();
+  cohort_lock(&cohort[k], my_node);
+}
+
+static always_inline void test_cohort_unlock(uint32_t k) { cohort_unlock(&cohort[k], my_node); }
+
+/*
+ *    Waiting policies for oversubscription: the spin locks above burn their
+ *    whole time slice when the holder (or the next ticket or queue owner) is
+ *    preempted. The -yield variants call sched_yield after SPIN_TRIES pauses,
+ *    the -park variants sleep in FUTEX_WAIT on a per-lock sequence that the
+ *    unlock bumps when somebody sleeps (it wakes them all, the ones that
+ *    cannot go yet sleep again)
+ */
+enum { WAIT_SPIN, WAIT_YIELD, WAIT_PARK };
+
+#define SPIN_TRIES 128
+
+struct {
+  uint32_t _Atomic seq;
+  uint32_t _Atomic nb_sleepers;
+} __attribute__((aligned(CACHE_LINE))) park[MAX_LOCKS];
+
+/*
+ * cond is evaluated again after nb_sleepers is incremented: either the unlock
+ * sees the sleeper and changes seq, or the sleeper sees the unlock
+ */
+#define wait_until(cond, k, policy)                                     \
+  for(uint32_t _i=0; !(cond); _i++) {                                   \
+    if((policy) == WAIT_SPIN || _i < SPIN_TRIES)                        \
+      asm_pause();                                                      \
+    else if((policy) == WAIT_YIELD)                                     \
+      sched_yield();                                                    \
+    else {                                                              \
+      atomic_fetch_add(&park[k].nb_sleepers, 1);                        \
+      uint32_t _seq = atomic_load(&park[k].seq);                        \
+      if(!(cond))                                                       \
+        futex_wait(&park[k].seq, _seq);                                 \
+      atomic_fetch_sub(&park[k].nb_sleepers, 1);                        \
+    }                                                                   \
+  }
+
+static always_inline void unpark(uint32_t k, int policy) {
+  if(policy == WAIT_PARK && atomic_load(&park[k].nb_sleepers)) {
+    atomic_fetch_add(&park[k].seq, 1);
+    futex_wake(&park[k].seq, INT_MAX);
+  }
+}
+
+static always_inline void spin_lock_w(uint32_t k, int policy) {
+  for(;;) {
+    wait_until(!atomic_load(&slock[k].v), k, policy);
+    if(!atomic_exchange(&slock[k].v, 1))
+      return;
+  }
+}
+
+static always_inline void spin_unlock_w(uint32_t k, int policy) {
+  atomic_store(&slock[k].v, 0);
+  unpark(k, policy);
+}
+
+static always_inline void ticket_lock_w(uint32_t k, int policy) {
+  uint64_t my = atomic_fetch_add(&ticket[k].counter, 1);
+  wait_until(atomic_load(&ticket[k].screen) >= my, k, policy);
+}
+
+static always_inline void ticket_unlock_w(uint32_t k, int policy) {
+  atomic_fetch_add(&ticket[k].screen, 1);
+  unpark(k, policy);
+}
+
+static always_inline void mcs_lock_w(uint32_t k, int policy) {
+  if(mcs_enqueue(&mcs[k].v, &my_mcs[k]))
+    wait_until(atomic_load(&my_mcs[k].is_free), k, policy);
+}
+
+static always_inline void mcs_unlock_w(uint32_t k, int policy) {
+  if(mcs_release(&mcs[k].v, &my_mcs[k]))
     return;
-  while(!atomic_load(&my.next)) { asm_pause(); }
-  atomic_store(&my.next->is_free, true);
+  /* nobody wakes us when the successor links itself: yield instead of parking */
+  wait_until(atomic_load(&my_mcs[k].next), k, policy == WAIT_PARK ? WAIT_YIELD : policy);
+  atomic_store(&atomic_load(&my_mcs[k].next)->is_free, true);
+  unpark(k, policy);
 }
 
+#define WAIT_VARIANTS(name)                                             \
+  static always_inline void name##_lock_yield(uint32_t k) { name##_lock_w(k, WAIT_YIELD); } \
+  static always_inline void name##_unlock_yield(uint32_t k) { name##_unlock_w(k, WAIT_YIELD); } \
+  static always_inline void name##_lock_park(uint32_t k) { name##_lock_w(k, WAIT_PARK); } \
+  static always_inline void name##_unlock_park(uint32_t k) { name##_unlock_w(k, WAIT_PARK); }
+
+WAIT_VARIANTS(spin)
+WAIT_VARIANTS(ticket)
+WAIT_VARIANTS(mcs)
+
 /*
  *   POSIX lock
  */
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+padded(pthread_mutex_t) mutex[MAX_LOCKS];
 
-void posix_lock() {
-  pthread_mutex_lock(&mutex);
+static always_inline void posix_lock(uint32_t k) {
+  pthread_mutex_lock(&mutex[k].v);
 }
 
-void posix_unlock() {
-  pthread_mutex_unlock(&mutex);
+static always_inline void posix_unlock(uint32_t k) {
+  pthread_mutex_unlock(&mutex[k].v);
 }
 
 /*
  *   Home-made POSIX lock
  */
-futex_lock_t flock;
+padded(futex_lock_t) flock[MAX_LOCKS];
+
+static always_inline void test_futex_lock(uint32_t k) { futex_lock(&flock[k].v); }
+static always_inline void test_futex_unlock(uint32_t k) { futex_unlock(&flock[k].v); }
+
+/*
+ *   Same lock acquired with futex_lock_timed: a thread that gives up counts a
+ *   timeout and tries again, so the waits are bounded by TIMED_LOCK_NS
+ */
+#define TIMED_LOCK_NS 1000
+
+static _Thread_local uint64_t nb_timeouts;
+
+static always_inline void timed_lock(uint32_t k) {
+  while(!futex_lock_timed(&flock[k].v, TIMED_LOCK_NS))
+    nb_timeouts++;
+}
+
+/*
+ *   Fair futex lock: ticket order, the unlock hands over to the next waiter
+ */
+padded(futex_fair_lock_t) fair[MAX_LOCKS];
+
+static always_inline void test_fair_lock(uint32_t k) { futex_fair_lock(&fair[k].v); }
+static always_inline void test_fair_unlock(uint32_t k) { futex_fair_unlock(&fair[k].v); }
+
+/*
+ *   Adaptive spin-then-park futex lock
+ */
+padded(futex_adaptive_lock_t) alock[MAX_LOCKS];
+
+static always_inline void test_adaptive_lock(uint32_t k) { futex_adaptive_lock(&alock[k].v); }
+static always_inline void test_adaptive_unlock(uint32_t k) { futex_adaptive_unlock(&alock[k].v); }
+
+/*
+ *   Reader-writer locks (rwlock.h)
+ */
+rw_lock_t rwr[MAX_LOCKS];       /* reader-preferring */
+rw_lock_t rww[MAX_LOCKS];       /* writer-preferring */
+br_lock_t brl[MAX_LOCKS];
+_Thread_local int br_slot;      /* a thread reads under one lock at a time */
+padded(pthread_rwlock_t) prw[MAX_LOCKS];
+
+static always_inline void rwr_lock(uint32_t k) { rw_write_lock(&rwr[k]); }
+static always_inline void rwr_unlock(uint32_t k) { rw_write_unlock(&rwr[k]); }
+static always_inline void rwr_rlock(uint32_t k) { rw_read_lock(&rwr[k]); }
+static always_inline void rwr_runlock(uint32_t k) { rw_read_unlock(&rwr[k]); }
+
+static always_inline void rww_lock(uint32_t k) { rw_write_lock(&rww[k]); }
+static always_inline void rww_unlock(uint32_t k) { rw_write_unlock(&rww[k]); }
+static always_inline void rww_rlock(uint32_t k) { rw_read_lock(&rww[k]); }
+static always_inline void rww_runlock(uint32_t k) { rw_read_unlock(&rww[k]); }
+
+static always_inline void brl_lock(uint32_t k) { br_write_lock(&brl[k]); }
+static always_inline void brl_unlock(uint32_t k) { br_write_unlock(&brl[k]); }
+static always_inline void brl_rlock(uint32_t k) { br_slot = br_read_lock(&brl[k]); }
+static always_inline void brl_runlock(uint32_t k) { br_read_unlock(&brl[k], br_slot); }
+
+static always_inline void prw_lock(uint32_t k) { pthread_rwlock_wrlock(&prw[k].v); }
+static always_inline void prw_rlock(uint32_t k) { pthread_rwlock_rdlock(&prw[k].v); }
+static always_inline void prw_unlock(uint32_t k) { pthread_rwlock_unlock(&prw[k].v); }
+
+/*
+ *   Delegation locks (delegation.h): the critical sections are closures run
+ *   by the current combiner (fc) or by one server thread for all the locks
+ *   (rcl), the slot of a thread is its index
+ */
+deleg_lock_t deleg[MAX_LOCKS];
+rcl_server_t rcl_server;
+
+static always_inline void fc_exec(uint32_t k, uint32_t self, deleg_fn_t cs) {
+  fc_execute(&deleg[k], self, cs, (void*)(uintptr_t)k);
+}
 
-void test_futex_lock() { futex_lock(&flock); }
-void test_futex_unlock() { futex_unlock(&flock); }
+static always_inline void rcl_exec(uint32_t k, uint32_t self, deleg_fn_t cs) {
+  rcl_execute(&deleg[k], self, cs, (void*)(uintptr_t)k);
+}
+
+void rcl_server_start() { rcl_start(&rcl_server, deleg, nb_locks); }
+void rcl_server_stop() { rcl_stop(&rcl_server); }
+
+/*
+ *   RCU (rcu.h): the readers take no lock and write nothing shared, the
+ *   writers serialize on a futex lock. Every thread announces a quiescent
+ *   state once every RCU_QS_PERIOD sections, it registers at its first
+ *   section and is unregistered when it exits
+ */
+#define RCU_QS_PERIOD 64
+
+padded(futex_lock_t) rcu_wlock[MAX_LOCKS];
+_Thread_local uint32_t rcu_sections;
+
+static always_inline void rcu_tick() {
+  if(++rcu_sections % RCU_QS_PERIOD == 0)
+    rcu_quiescent_state();
+}
+
+static always_inline void rcu_rlock(uint32_t k) {
+  if(!rcu_me)
+    rcu_register_thread();
+  rcu_read_lock();
+}
+
+static always_inline void rcu_runlock(uint32_t k) {
+  rcu_read_unlock();
+  rcu_tick();
+}
+
+static always_inline void rcu_lock(uint32_t k) {
+  if(!rcu_me)
+    rcu_register_thread();
+  futex_lock(&rcu_wlock[k].v);
+}
+
+static always_inline void rcu_unlock(uint32_t k) {
+  futex_unlock(&rcu_wlock[k].v);
+  rcu_tick();
+}
 
 /*
  *   Benchmark
  */ 
 
+/*
+ * Acquire wait times go to a per-thread log-linear histogram: 4 sub-buckets
+ * per power of two of TSC cycles, so a percentile is known within 25%. The
+ * loop only counts cycles, they are converted to ns when reporting
+ */
+#define HIST_SUB_BITS 2
+#define HIST_BUCKETS  (64 << HIST_SUB_BITS)
+
+enum { OUTPUT_TEXT, OUTPUT_CSV, OUTPUT_JSON };
+
+bool measure = false;           /* -L: time every acquisition */
+int output = OUTPUT_TEXT;
+double duration = 0;            /* -d: run for a duration instead of it iterations */
+int _Atomic stop = 0;
+
 int _Atomic nb_started = 0;
 struct {
   pthread_t  tid;
   double     elapsed;
-}* stats;
+  uint32_t   nb_writes;
+  uint64_t   nb_ops;
+  uint64_t   nb_timeouts;       /* futex-timed */
+  uint64_t   max_wait;          /* cycles */
+  uint64_t   hist[HIST_BUCKETS];
+} __attribute__((aligned(CACHE_LINE)))* stats;
+
+static inline int hist_bucket(uint64_t cycles) {
+  if(cycles < (1 << HIST_SUB_BITS))
+    return cycles;
+  int msb = 63 - __builtin_clzll(cycles);
+  return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+    ((cycles >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/* largest value of a bucket */
+static uint64_t hist_value(int b) {
+  if(b < (1 << HIST_SUB_BITS))
+    return b;
+  int msb = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+  uint64_t low = (1ull << msb) | ((uint64_t)(b & ((1 << HIST_SUB_BITS) - 1)) << (msb - HIST_SUB_BITS));
+  return low + (1ull << (msb - HIST_SUB_BITS)) - 1;
+}
+
+/* in ns */
+static uint64_t hist_percentile(const uint64_t* hist, double p) {
+  uint64_t total = 0, seen = 0;
+  for(int b=0; b<HIST_BUCKETS; b++)
+    total += hist[b];
+  for(int b=0; b<HIST_BUCKETS; b++) {
+    seen += hist[b];
+    if(total && seen > (uint64_t)(p * total))
+      return tsc_to_ns(hist_value(b));
+  }
+  return 0;
+}
+
+static always_inline void record_wait(uint32_t self, uint64_t start) {
+  uint64_t wait = tsc_now() - start;
+  stats[self].hist[hist_bucket(wait)]++;
+  if(wait > stats[self].max_wait)
+    stats[self].max_wait = wait;
+}
+
+/* all the times of the benchmark loop are TSC cycles (tsc.h) */
+static always_inline uint64_t delay(uint64_t from, uint64_t cycles) {
+  return cycles ? tsc_delay_until(from + cycles) : from;
+}
+
+static always_inline void read_lines(uint32_t k) {
+  for(uint32_t j=0; j<nb_lines; j++)
+    atomic_load_explicit((uint64_t _Atomic*)&data[k][j].v, memory_order_relaxed);
+}
 
-double gettime() {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return ts.tv_sec*1e0 + ts.tv_nsec*1e-9;
+static always_inline void write_lines(uint32_t k) {
+  for(uint32_t j=0; j<nb_lines; j++)
+    data[k][j].v++;
 }
 
-double delay(double from, uint32_t d) {
-  if(d) {
-    double res;
+static void free_payload(struct rcu_head* head) {
+  free((char*)head - offsetof(struct payload, rcu));
+}
+
+static always_inline void read_ptr(uint32_t k) {
+  if(swap)
+    atomic_load_explicit((uint64_t _Atomic*)&rcu_dereference(ptr[k].v)->v, memory_order_relaxed);
+}
+
+static always_inline void write_ptr(uint32_t k) {
+  if(swap) {
+    struct payload* old = atomic_load_explicit(&ptr[k].v, memory_order_relaxed); /* we are the writer */
+    struct payload* new = malloc(sizeof(*new));
+    new->v = old->v + 1;
+    rcu_assign_pointer(ptr[k].v, new);
+    if(deferred_free)
+      call_rcu(&old->rcu, free_payload);
+    else
+      free(old);
+  }
+}
+
+/* critical sections of the delegation locks, arg is the lock index */
+static void cs_read(void* arg) {
+  uint32_t k = (uintptr_t)arg;
+  atomic_load_explicit((uint32_t _Atomic*)&z[k].v, memory_order_relaxed);
+  read_lines(k);
+  read_ptr(k);
+  if(csd_cycles)
+    delay(tsc_now(), csd_cycles);
+}
 
-    do {
-      res = gettime();
-    } while(res < from + d*1e-9);
+static void cs_write(void* arg) {
+  uint32_t k = (uintptr_t)arg;
+  z[k].v++;
+  write_lines(k);
+  write_ptr(k);
+  if(csd_cycles)
+    delay(tsc_now(), csd_cycles);
+}
 
-    return res;
-  } else
-    return from;
+/* per-thread xorshift: picks the reads without sharing anything */
+static inline uint32_t next_rand(uint32_t* seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
 }
 
-void* f(void* _arg) {
-  uint32_t self = (uint32_t)(uintptr_t)_arg;
+/*
+ * f is instantiated once per lock by BENCH: lock and unlock are compile-time
+ * constants of each instance, so they are inlined in the loop instead of being
+ * called through a function pointer
+ */
+static always_inline void f(uint32_t self, void (*lock)(uint32_t), void (*unlock)(uint32_t),
+                            void (*rlock)(uint32_t), void (*runlock)(uint32_t),
+                            void (*exec)(uint32_t, uint32_t, deleg_fn_t)) {
   atomic_fetch_add(&nb_started, 1);
   while(atomic_load(&nb_started) < n) { asm_pause(); }
 
-  double start = gettime();
-  double cur = start;
+  uint64_t start = tsc_now();
+  uint64_t cur = start;
+  uint32_t k = self % nb_locks;
+  uint32_t seed = 2463534242u + self;
+  uint32_t nb_writes = 0;
+  uint64_t i, t0 = 0;
   
-  for(int i=0; i<it; i++) {
-    ze_lock();
-    z++;
-    cur = delay(cur, csd);
-    ze_unlock();
-    cur = delay(cur, cd);
+  for(i=0; duration ? !atomic_load_explicit(&stop, memory_order_relaxed) : i<it; i++) {
+    if(measure)
+      t0 = tsc_now();
+    if(exec) {
+      /*
+       * delegation: the locks cannot be held, a write on two locks is two
+       * requests, and the measured wait includes the critical sections
+       */
+      bool read = read_pct && next_rand(&seed) % 100 < read_pct;
+      exec(k, self, read ? cs_read : cs_write);
+      if(!read)
+        nb_writes++;
+      if(nb_locks > 1) {
+        uint32_t b = k + 1 == nb_locks ? 0 : k + 1;
+        if(!read)
+          exec(b, self, cs_write);
+        k = b;
+      }
+      if(measure)
+        record_wait(self, t0);
+      cur = tsc_now();
+    } else if(read_pct && next_rand(&seed) % 100 < read_pct) {
+      rlock(k);
+      if(measure)
+        record_wait(self, t0);
+      atomic_load_explicit((uint32_t _Atomic*)&z[k].v, memory_order_relaxed); /* not elided: atomic */
+      read_lines(k);
+      read_ptr(k);
+      cur = delay(cur, csd_cycles);
+      runlock(k);
+      k = k + 1 == nb_locks ? 0 : k + 1;
+    } else if(nb_locks == 1) {
+      nb_writes++;
+      lock(0);
+      if(measure)
+        record_wait(self, t0);
+      z[0].v++;
+      write_lines(0);
+      write_ptr(0);
+      cur = delay(cur, csd_cycles);
+      unlock(0);
+    } else {
+      /* hold k and its neighbour, smallest index first to avoid deadlocks */
+      nb_writes++;
+      uint32_t a = k, b = k + 1 == nb_locks ? 0 : k + 1;
+      if(b < a) { a = b; b = k; }
+      lock(a);
+      lock(b);
+      if(measure)
+        record_wait(self, t0);
+      z[a].v++;
+      z[b].v++;
+      write_lines(a);
+      write_lines(b);
+      write_ptr(a);
+      write_ptr(b);
+      cur = delay(cur, csd_cycles);
+      unlock(b);
+      unlock(a);
+      k = b;
+    }
+    cur = delay(cur, cd_cycles);
   }
   
-  stats[self].elapsed = gettime() - start;
-  
+  stats[self].elapsed = tsc_to_ns(tsc_now() - start) * 1e-9;
+  stats[self].nb_writes = nb_writes;
+  stats[self].nb_ops = i;
+  stats[self].nb_timeouts = nb_timeouts;
+}
+
+#define BENCH_RW(name, lock, unlock, rlock, runlock)                    \
+  void* bench_##name(void* arg) {                                       \
+    f((uint32_t)(uintptr_t)arg, lock, unlock, rlock, runlock, NULL);    \
+    return 0;                                                           \
+  }
+#define BENCH(name, lock, unlock) BENCH_RW(name, lock, unlock, lock, unlock)
+#define BENCH_DELEG(name, exec)                                         \
+  void* bench_##name(void* arg) {                                       \
+    f((uint32_t)(uintptr_t)arg, NULL, NULL, NULL, NULL, exec);          \
+    return 0;                                                           \
+  }
+
+BENCH(spinlock, spin_lock, spin_unlock)
+BENCH(ttas, ttas_lock, spin_unlock)
+BENCH(ticket, ticket_lock, ticket_unlock)
+BENCH(ticket_pb, ticket_pb_lock, ticket_unlock)
+BENCH(mcs, test_mcs_lock, test_mcs_unlock)
+BENCH(spinlock_yield, spin_lock_yield, spin_unlock_yield)
+BENCH(spinlock_park, spin_lock_park, spin_unlock_park)
+BENCH(ticket_yield, ticket_lock_yield, ticket_unlock_yield)
+BENCH(ticket_park, ticket_lock_park, ticket_unlock_park)
+BENCH(mcs_yield, mcs_lock_yield, mcs_unlock_yield)
+BENCH(mcs_park, mcs_lock_park, mcs_unlock_park)
+BENCH(clh_loop, test_clh_lock, test_clh_unlock)
+BENCH(cohort, test_cohort_lock, test_cohort_unlock)
+BENCH(posix, posix_lock, posix_unlock)
+BENCH(futex, test_futex_lock, test_futex_unlock)
+BENCH(futex_timed, timed_lock, test_futex_unlock)
+BENCH(futex_fair, test_fair_lock, test_fair_unlock)
+BENCH(adaptive, test_adaptive_lock, test_adaptive_unlock)
+BENCH_RW(rw_readers, rwr_lock, rwr_unlock, rwr_rlock, rwr_runlock)
+BENCH_RW(rw_writers, rww_lock, rww_unlock, rww_rlock, rww_runlock)
+BENCH_RW(brlock, brl_lock, brl_unlock, brl_rlock, brl_runlock)
+BENCH_RW(posix_rw, prw_lock, prw_unlock, prw_rlock, prw_unlock)
+BENCH_DELEG(fc, fc_exec)
+BENCH_DELEG(rcl, rcl_exec)
+BENCH_RW(rcu, rcu_lock, rcu_unlock, rcu_rlock, rcu_runlock)
+
+/* the clh nodes outlive the loop, see test_clh_lock */
+void* bench_clh(void* arg) {
+  bench_clh_loop(arg);
+  clh_free_nodes();
   return 0;
 }
 
-int main(int argc, char** argv) {
-  if(argc < 6) {
-    fprintf(stderr, "Usage: %s nb-threads it csd cd algo\n", argv[0]);
-    exit(1);
+/*
+ * algo chooses which loop the threads run, and what runs around them (the
+ * server thread of rcl)
+ */
+struct algo {
+  const char* name;
+  void* (*bench)(void*);
+  void (*start)();
+  void (*stop)();
+  bool deferred_free;           /* -P: free the old copies with call_rcu */
+} algos[] = {
+  { "spinlock", bench_spinlock },
+  { "ttas",     bench_ttas },
+  { "ticket",   bench_ticket },
+  { "ticket-pb", bench_ticket_pb },
+  { "mcs",      bench_mcs },
+  { "spinlock-yield", bench_spinlock_yield },
+  { "spinlock-park",  bench_spinlock_park },
+  { "ticket-yield",   bench_ticket_yield },
+  { "ticket-park",    bench_ticket_park },
+  { "mcs-yield",      bench_mcs_yield },
+  { "mcs-park",       bench_mcs_park },
+  { "clh",      bench_clh },
+  { "cohort",   bench_cohort },
+  { "posix",    bench_posix },
+  { "futex",    bench_futex },
+  { "futex-timed", bench_futex_timed },
+  { "futex-fair", bench_futex_fair },
+  { "adaptive", bench_adaptive },
+  { "rw-readers", bench_rw_readers },
+  { "rw-writers", bench_rw_writers },
+  { "brlock",   bench_brlock },
+  { "posix-rw", bench_posix_rw },
+  { "fc",       bench_fc },
+  { "rcl",      bench_rcl, rcl_server_start, rcl_server_stop },
+  { "rcu",      bench_rcu, NULL, rcu_barrier, true },
+};
+
+/*
+ * Results: the average loop time, the acquire wait percentiles of all the
+ * threads (with -L), and the fairness of the per-thread throughputs: Jain's
+ * index is 1 when all the threads progress at the same rate, 1/n when a
+ * single one does all the work
+ */
+void report(const char* algo) {
+  uint64_t hist[HIST_BUCKETS] = { 0 };
+  uint64_t total_ops = 0, max_wait = 0, min_ops = UINT64_MAX, max_ops = 0, timeouts = 0;
+  double total = 0, sum_x = 0, sum_x2 = 0;
+
+  for(int i=0; i<n; i++) {
+    double x = stats[i].nb_ops / stats[i].elapsed;
+    total += stats[i].elapsed;
+    total_ops += stats[i].nb_ops;
+    timeouts += stats[i].nb_timeouts;
+    sum_x += x;
+    sum_x2 += x * x;
+    if(stats[i].nb_ops < min_ops) min_ops = stats[i].nb_ops;
+    if(stats[i].nb_ops > max_ops) max_ops = stats[i].nb_ops;
+    if(stats[i].max_wait > max_wait) max_wait = stats[i].max_wait;
+    for(int b=0; b<HIST_BUCKETS; b++)
+      hist[b] += stats[i].hist[b];
   }
-  n = atoi(argv[1]);
-  it = atoi(argv[2]);
-  csd = atoi(argv[3]);
-  cd = atoi(argv[4]);
-  char* algo = argv[5];
-  
-  stats = calloc(n, sizeof(*stats));
-  
-  printf("=== test with %s lock ===\n", algo);
-  if(strcmp(algo, "spinlock") == 0) {
-    ze_lock = spin_lock;
-    ze_unlock = spin_unlock;
-  } else if(strcmp(algo, "ticket") == 0) {
-    ze_lock = ticket_lock;
-    ze_unlock = ticket_unlock;
-  } else if(strcmp(algo, "mcs") == 0) {
-    ze_lock = mcs_lock;
-    ze_unlock = mcs_unlock;
-  } else if(strcmp(algo, "posix") == 0) {
-    ze_lock = posix_lock;
-    ze_unlock = posix_unlock;
-  } else if(strcmp(algo, "futex") == 0) {
-    ze_lock = test_futex_lock;
-    ze_unlock = test_futex_unlock;
-  } else {
-    fprintf(stderr, "unknow lock: %s\n", algo);
-    exit(1);
+
+  double av = (total*1e9 / total_ops) - cd;
+  double jain = sum_x2 > 0 ? sum_x * sum_x / (n * sum_x2) : 1;
+  uint64_t p50 = hist_percentile(hist, 0.50), p99 = hist_percentile(hist, 0.99);
+  max_wait = tsc_to_ns(max_wait);
+
+  switch(output) {
+  case OUTPUT_TEXT:
+    printf("Average: %0.0lf ns per loop (with a delay of %u ns => %0.0lf ns)\n", av, csd, av - csd);
+    if(measure)
+      printf("Acquire: p50 %lu ns, p99 %lu ns, max %lu ns\n", p50, p99, max_wait);
+    printf("Fairness: %0.3lf (from %lu to %lu loops per thread)\n", jain, min_ops, max_ops);
+    if(timeouts)
+      printf("Timeouts: %lu acquisitions gave up after %u ns and retried\n", timeouts, TIMED_LOCK_NS);
+    break;
+
+  case OUTPUT_CSV:
+    /* one row per thread, then the whole run as thread "all" */
+    printf("algo,threads,csd,cd,locks,read_pct,thread,ops,ns_per_loop,p50_ns,p99_ns,max_ns,jain\n");
+    for(int i=0; i<n; i++)
+      printf("%s,%u,%u,%u,%u,%u,%d,%lu,%0.1lf,%lu,%lu,%lu,\n", algo, n, csd, cd, nb_locks, read_pct, i,
+             stats[i].nb_ops, stats[i].elapsed*1e9 / stats[i].nb_ops - cd,
+             hist_percentile(stats[i].hist, 0.50), hist_percentile(stats[i].hist, 0.99),
+             (uint64_t)tsc_to_ns(stats[i].max_wait));
+    printf("%s,%u,%u,%u,%u,%u,all,%lu,%0.1lf,%lu,%lu,%lu,%0.4lf\n", algo, n, csd, cd, nb_locks, read_pct,
+           total_ops, av, p50, p99, max_wait, jain);
+    break;
+
+  case OUTPUT_JSON:
+    printf("{\"algo\": \"%s\", \"threads\": %u, \"csd\": %u, \"cd\": %u, \"locks\": %u, \"read_pct\": %u,\n",
+           algo, n, csd, cd, nb_locks, read_pct);
+    printf(" \"ops\": %lu, \"ns_per_loop\": %0.1lf, \"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, \"jain\": %0.4lf,\n",
+           total_ops, av, p50, p99, max_wait, jain);
+    printf(" \"per_thread\": [");
+    for(int i=0; i<n; i++)
+      printf("%s\n  {\"ops\": %lu, \"ns_per_loop\": %0.1lf, \"p50_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu}",
+             i ? "," : "", stats[i].nb_ops, stats[i].elapsed*1e9 / stats[i].nb_ops - cd,
+             hist_percentile(stats[i].hist, 0.50), hist_percentile(stats[i].hist, 0.99),
+             (uint64_t)tsc_to_ns(stats[i].max_wait));
+    printf("]}\n");
+    break;
+  }
+}
+
+/*
+ * Thread placement (-p): compact fills the CPUs in the hwloc logical order
+ * (hyperthreads, then cores, then packages), scatter spreads the threads as
+ * far as possible from each other with hwloc_distrib. The topology is
+ * restricted to the CPUs the process may run on, so both only pick from those
+ */
+enum { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+int pin = PIN_NONE;
+hwloc_topology_t topology;
+
+void place_threads(cpu_set_t* cpus) {
+  int nb_pus = hwloc_get_nbobjs_by_type(topology, HWLOC_OBJ_PU);
+  hwloc_bitmap_t sets[n];
+
+  if(pin == PIN_SCATTER) {
+    hwloc_obj_t root = hwloc_get_root_obj(topology);
+    hwloc_distrib(topology, &root, 1, sets, n, INT_MAX, 0);
+  }
+
+  for(int i=0; i<n; i++) {
+    int cpu;
+    if(pin == PIN_SCATTER) {
+      hwloc_bitmap_singlify(sets[i]);
+      cpu = hwloc_bitmap_first(sets[i]);
+      hwloc_bitmap_free(sets[i]);
+    } else
+      cpu = hwloc_bitmap_first(hwloc_get_obj_by_type(topology, HWLOC_OBJ_PU, i % nb_pus)->cpuset);
+
+    CPU_ZERO(&cpus[i]);
+    CPU_SET(cpu, &cpus[i]);
+  }
+}
+
+/*
+ * One run of a benchmark with the current n, csd and cd: the threads are
+ * created already placed, so none of them starts timing on the wrong CPU
+ */
+void run(struct algo* algo) {
+  if(algo->start)
+    algo->start();
+  csd_cycles = tsc_from_ns(csd);
+  cd_cycles = tsc_from_ns(cd);
+  atomic_store(&nb_started, 0);
+  atomic_store(&stop, 0);
+  deferred_free = algo->deferred_free;
+  memset(z, 0, sizeof(z));
+  for(int k=0; k<nb_locks; k++) {
+    memset(data[k], 0, nb_lines * sizeof(*data[k]));
+    ptr[k].v->v = 0;
+  }
+  memset(stats, 0, n * sizeof(*stats));
+
+  cpu_set_t cpus[n];
+  if(pin != PIN_NONE)
+    place_threads(cpus);
+
+  for(int i=0; i<n; i++) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if(pin != PIN_NONE)
+      pthread_attr_setaffinity_np(&attr, sizeof(cpus[i]), &cpus[i]);
+    if(pthread_create(&stats[i].tid, &attr, algo->bench, (void*)(uintptr_t)i)) {
+      fprintf(stderr, "cannot create thread %d\n", i);
+      exit(1);
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  if(duration > 0) {
+    while(atomic_load(&nb_started) < n)
+      usleep(1000);
+    usleep(duration * 1e6);
+    atomic_store(&stop, 1);
   }
-  
-  for(int i=0; i<n; i++)
-    pthread_create(&stats[i].tid, NULL, f, (void*)(uintptr_t)i);
 
   for(int i=0; i<n; i++) {
     void* retval;
     pthread_join(stats[i].tid, &retval);
   }
 
-  double total = 0;
+  if(algo->stop)
+    algo->stop();
+
+  uint32_t sum = 0, expected = 0;
   for(int i=0; i<n; i++)
+    expected += stats[i].nb_writes * (nb_locks > 1 ? 2 : 1);
+  for(int i=0; i<nb_locks; i++)
+    sum += z[i].v;
+  if(sum != expected)
+    printf("Integrity check failed: %u for %u\n", sum, expected);
+  for(int k=0; k<nb_locks; k++)
+    for(int j=0; j<nb_lines; j++)
+      if(data[k][j].v != z[k].v) {
+        printf("Integrity check failed: line %d of lock %d is %lu for %u\n", j, k, data[k][j].v, z[k].v);
+        return;
+      }
+  for(int k=0; k<nb_locks && swap; k++)
+    if(ptr[k].v->v != z[k].v) {
+      printf("Integrity check failed: pointer of lock %d is %lu for %u\n", k, ptr[k].v->v, z[k].v);
+      return;
+    }
+}
+
+/* ns per loop of the last run, as printed by report */
+double average() {
+  double total = 0;
+  uint64_t total_ops = 0;
+
+  for(int i=0; i<n; i++) {
     total += stats[i].elapsed;
+    total_ops += stats[i].nb_ops;
+  }
+  return (total*1e9 / total_ops) - cd;
+}
+
+/* loops per second of all the threads in the last run */
+double throughput() {
+  double wall = 0;
+  uint64_t total_ops = 0;
+
+  for(int i=0; i<n; i++) {
+    if(stats[i].elapsed > wall)
+      wall = stats[i].elapsed;
+    total_ops += stats[i].nb_ops;
+  }
+  return total_ops / wall;
+}
+
+/* longest acquire wait of the last run in ns (with -L) */
+uint64_t worst_wait() {
+  uint64_t max = 0;
+
+  for(int i=0; i<n; i++)
+    if(stats[i].max_wait > max)
+      max = stats[i].max_wait;
+  return tsc_to_ns(max);
+}
+
+/*
+ * Sweep: nb-threads, csd, cd and algo are comma-separated lists, every point
+ * of their product is run warmup times for nothing then repeat times, and
+ * gives one line with the median, the extremes and the spread (max - min) of
+ * the ns per loop of the repeats, their median throughput and the longest
+ * acquire wait of them all.
+ *
+ * Oversubscription: a thread count Nx means N times the CPUs of the affinity
+ * mask, e.g., 2x,4x,8x, and turns -L on
+ */
+#define MAX_POINTS 64
+
+int parse_list(char* arg, uint32_t* values, uint32_t x) {
+  int nb = 0;
+  for(char* tok = strtok(arg, ","); tok && nb < MAX_POINTS; tok = strtok(NULL, ",")) {
+    values[nb++] = atoi(tok);
+    if(tok[strlen(tok) - 1] == 'x') {
+      values[nb - 1] *= x;
+      measure = true;
+    }
+  }
+  return nb;
+}
+
+int cmp_double(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+void sweep_header() {
+  switch(output) {
+  case OUTPUT_TEXT:
+    printf("%-14s %7s %7s %7s %10s %10s %10s %7s %10s %12s\n",
+           "algo", "threads", "csd", "cd", "median", "min", "max", "spread", "Mloops/s", "max-wait");
+    break;
+  case OUTPUT_CSV:
+    printf("algo,threads,csd,cd,locks,read_pct,repeats,median_ns,min_ns,max_ns,spread_pct,loops_per_s,max_wait_ns\n");
+    break;
+  case OUTPUT_JSON:
+    printf("[");
+    break;
+  }
+}
+
+/* sorts v */
+double median_of(double* v, int nb) {
+  qsort(v, nb, sizeof(*v), cmp_double);
+  return nb % 2 ? v[nb/2] : (v[nb/2 - 1] + v[nb/2]) / 2;
+}
+
+void sweep_line(const char* algo, double* samples, double* tputs, uint64_t worst, int nb, bool first) {
+  double median = median_of(samples, nb);
+  double spread = median > 0 ? 100 * (samples[nb-1] - samples[0]) / median : 0;
+  double tput = median_of(tputs, nb);
+
+  switch(output) {
+  case OUTPUT_TEXT:
+    printf("%-14s %7u %7u %7u %10.1lf %10.1lf %10.1lf %6.1lf%% %10.3lf %12lu\n",
+           algo, n, csd, cd, median, samples[0], samples[nb-1], spread, tput * 1e-6, worst);
+    break;
+  case OUTPUT_CSV:
+    printf("%s,%u,%u,%u,%u,%u,%d,%0.1lf,%0.1lf,%0.1lf,%0.1lf,%0.0lf,%lu\n",
+           algo, n, csd, cd, nb_locks, read_pct, nb, median, samples[0], samples[nb-1], spread, tput, worst);
+    break;
+  case OUTPUT_JSON:
+    printf("%s\n {\"algo\": \"%s\", \"threads\": %u, \"csd\": %u, \"cd\": %u, \"locks\": %u, \"read_pct\": %u, "
+           "\"repeats\": %d, \"median_ns\": %0.1lf, \"min_ns\": %0.1lf, \"max_ns\": %0.1lf, \"spread_pct\": %0.1lf, "
+           "\"loops_per_s\": %0.0lf, \"max_wait_ns\": %lu}",
+           first ? "" : ",", algo, n, csd, cd, nb_locks, read_pct, nb, median, samples[0], samples[nb-1], spread,
+           tput, worst);
+    break;
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  int opt;
+  int warmup = 0, repeat = 1;
+  while((opt = getopt(argc, argv, "l:r:Lo:d:p:w:R:c:P")) != -1) {
+    switch(opt) {
+    case 'l': nb_locks = atoi(optarg); break;
+    case 'r': read_pct = atoi(optarg); break;
+    case 'c': nb_lines = atoi(optarg); break;
+    case 'P': swap = true; break;
+    case 'L': measure = true; break;
+    case 'd': duration = atof(optarg); break;
+    case 'w': warmup = atoi(optarg); break;
+    case 'R': repeat = atoi(optarg); break;
+    case 'p':
+      if(strcmp(optarg, "compact") == 0)
+        pin = PIN_COMPACT;
+      else if(strcmp(optarg, "scatter") == 0)
+        pin = PIN_SCATTER;
+      else if(strcmp(optarg, "none") != 0)
+        argc = 0;
+      break;
+    case 'o':
+      if(strcmp(optarg, "csv") == 0)
+        output = OUTPUT_CSV;
+      else if(strcmp(optarg, "json") == 0)
+        output = OUTPUT_JSON;
+      else if(strcmp(optarg, "text") != 0)
+        argc = 0;
+      break;
+    default: argc = 0;
+    }
+  }
+  if(argc - optind < 5) {
+    fprintf(stderr, "Usage: %s [-l nb-locks] [-r read-%%] [-c nb-lines] [-P] [-L] [-o text|csv|json] [-d seconds]\n"
+            "         [-p none|compact|scatter] [-w warmup] [-R repeat] nb-threads it csd cd algo\n", argv[0]);
+    fprintf(stderr, "  -c: the critical sections also update nb-lines shared cache lines\n");
+    fprintf(stderr, "  -P: the critical sections also read or replace (read-copy-update) a shared pointer\n");
+    fprintf(stderr, "  -L: measure the acquire wait times, -d: run for a duration (it is ignored)\n");
+    fprintf(stderr, "  sweep: nb-threads, csd, cd and algo can be comma-separated lists (algo can be all)\n");
+    fprintf(stderr, "  oversubscription: a nb-threads Nx is N times the CPUs of the affinity mask\n");
+    exit(1);
+  }
+  argv += optind - 1;
+  uint32_t threads[MAX_POINTS], csds[MAX_POINTS], cds[MAX_POINTS];
+  tsc_init();
 
-  double av = (total*1e9 / (n * it)) - cd;
-  printf("Average: %0.0lf ns per loop (with a delay of %u ns => %0.0lf ns)\n", av, csd, av - csd);
+  cpu_set_t affinity;
+  sched_getaffinity(0, sizeof(affinity), &affinity);
+  int nb_threads = parse_list(argv[1], threads, CPU_COUNT(&affinity));
+  it = atoi(argv[2]);
+  int nb_csds = parse_list(argv[3], csds, 1);
+  int nb_cds = parse_list(argv[4], cds, 1);
+  char* algo_list = argv[5];
+  if(!nb_threads || !nb_csds || !nb_cds || repeat < 1 || warmup < 0) {
+    fprintf(stderr, "empty sweep\n");
+    exit(1);
+  }
+  if(nb_locks < 1 || nb_locks > MAX_LOCKS) {
+    fprintf(stderr, "nb-locks must be between 1 and %d\n", MAX_LOCKS);
+    exit(1);
+  }
+  if(read_pct > 100) {
+    fprintf(stderr, "read-%% must be between 0 and 100\n");
+    exit(1);
+  }
+
+  for(int i=0; i<MAX_LOCKS; i++) {
+    pthread_mutex_init(&mutex[i].v, NULL);
+    mcs_init(&mcs[i].v);
+    clh_init(&clh[i].v);
+    cohort_init(&cohort[i], COHORT_MAX_HANDOFFS);
+    futex_fair_init(&fair[i].v);
+    futex_adaptive_init(&alock[i].v);
+    rw_init(&rwr[i], false);
+    rw_init(&rww[i], true);
+    br_init(&brl[i]);
+    pthread_rwlock_init(&prw[i].v, NULL);
+  }
+  
+  struct algo* selected[MAX_POINTS];
+  int nb_algos = 0;
+  for(char* algo = strtok(algo_list, ","); algo; algo = strtok(NULL, ",")) {
+    bool found = false;
+    for(int i=0; i<sizeof(algos)/sizeof(algos[0]); i++)
+      if(strcmp(algo, "all") == 0 || strcmp(algo, algos[i].name) == 0) {
+        found = true;
+        bool dup = false;
+        for(int j=0; j<nb_algos; j++)
+          dup |= selected[j] == &algos[i];
+        if(dup)
+          continue;
+        if(nb_algos == MAX_POINTS) {
+          fprintf(stderr, "too many locks (max %d)\n", MAX_POINTS);
+          exit(1);
+        }
+        selected[nb_algos++] = &algos[i];
+      }
+    if(!found) {
+      fprintf(stderr, "unknow lock: %s\n", algo);
+      exit(1);
+    }
+  }
+
+  if(pin != PIN_NONE) {
+    hwloc_topology_init(&topology);
+    hwloc_topology_load(topology);
+    hwloc_bitmap_t allowed = hwloc_bitmap_alloc();
+    if(!hwloc_get_cpubind(topology, allowed, HWLOC_CPUBIND_PROCESS))
+      hwloc_topology_restrict(topology, allowed, 0);
+    hwloc_bitmap_free(allowed);
+  }
+
+  uint32_t max_threads = 0;
+  for(int i=0; i<nb_threads; i++)
+    if(threads[i] > max_threads)
+      max_threads = threads[i];
+  stats = aligned_alloc(CACHE_LINE, max_threads * sizeof(*stats));
+  for(int k=0; k<nb_locks; k++)
+    deleg_init(&deleg[k], max_threads);
+  for(int k=0; k<nb_locks; k++)
+    data[k] = aligned_alloc(CACHE_LINE, (nb_lines + 1) * sizeof(*data[k])); /* never 0 bytes */
+  for(int k=0; k<nb_locks; k++)
+    ptr[k].v = calloc(1, sizeof(struct payload));
+
+  /* a single point without repeats prints the detailed report of the run */
+  if(nb_algos == 1 && nb_threads == 1 && nb_csds == 1 && nb_cds == 1 && repeat == 1 && !warmup) {
+    n = threads[0];
+    csd = csds[0];
+    cd = cds[0];
+    if(output == OUTPUT_TEXT)
+      printf("=== test with %s lock ===\n", selected[0]->name);
+    run(selected[0]);
+    report(selected[0]->name);
+    return 0;
+  }
 
-  if(z != n * it)
-    printf("Integrity check failed: %u for %u\n", z, n * it);
+  double samples[repeat], tputs[repeat];
+  bool first = true;
+  sweep_header();
+  for(int a=0; a<nb_algos; a++)
+    for(int t=0; t<nb_threads; t++)
+      for(int s=0; s<nb_csds; s++)
+        for(int c=0; c<nb_cds; c++) {
+          n = threads[t];
+          csd = csds[s];
+          cd = cds[c];
+          for(int r=0; r<warmup; r++)
+            run(selected[a]);
+          uint64_t worst = 0;
+          for(int r=0; r<repeat; r++) {
+            run(selected[a]);
+            samples[r] = average();
+            tputs[r] = throughput();
+            if(worst_wait() > worst)
+              worst = worst_wait();
+          }
+          sweep_line(selected[a]->name, samples, tputs, worst, repeat, first);
+          first = false;
+        }
+  if(output == OUTPUT_JSON)
+    printf("]\n");
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include <stdlib.h>
+#include "queuelock.h"
+
+void mcs_init(mcs_lock_t* lock) {
+  atomic_init(&lock->tail, NULL);
+}
+
+clh_node_t* clh_node_alloc() {
+  clh_node_t* node = aligned_alloc(QNODE_ALIGN, sizeof(*node));
+
+  atomic_init(&node->locked, false);
+  node->pred = NULL;
+
+  return node;
+}
+
+void clh_init(clh_lock_t* lock) {
+  atomic_init(&lock->tail, clh_node_alloc()); /* a free lock has a released node */
+}
+
+void clh_destroy(clh_lock_t* lock) {
+  free(atomic_load(&lock->tail));
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef _QUEUE_LOCK_H_
+#define _QUEUE_LOCK_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define QNODE_ALIGN 64 /* every waiter spins on its own cache line */
+
+#ifndef asm_pause
+#define asm_pause() asm volatile("pause")
+#endif
+
+/*
+ *    MCS lock: a waiter spins on its own queue node, its predecessor hands
+ *    the lock over by writing in it. The queue node is provided by the caller
+ *    and must stay alive until the unlock: a thread that holds several MCS
+ *    locks at once uses one node per held lock.
+ */
+typedef struct mcs_node {
+  struct mcs_node* _Atomic next;
+  bool _Atomic is_free;
+} __attribute__((aligned(QNODE_ALIGN))) mcs_node_t;
+
+typedef struct {
+  mcs_node_t* _Atomic tail;
+} mcs_lock_t;
+
+extern void mcs_init(mcs_lock_t* lock);
+
+/*
+ * The two halves of mcs_lock and mcs_unlock, for callers with their own way
+ * of waiting: when mcs_enqueue returns true, the caller waits for me->is_free;
+ * when mcs_release returns false, a successor is coming, the caller waits for
+ * me->next and sets its is_free
+ */
+static inline bool mcs_enqueue(mcs_lock_t* lock, mcs_node_t* me) {
+  atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&me->is_free, false, memory_order_relaxed);
+
+  mcs_node_t* p = atomic_exchange(&lock->tail, me);
+  if(p)
+    atomic_store(&p->next, me);
+  return p;
+}
+
+static inline bool mcs_release(mcs_lock_t* lock, mcs_node_t* me) {
+  mcs_node_t* expected = me;
+  return !atomic_load(&me->next) &&
+    atomic_compare_exchange_strong(&lock->tail, &expected, NULL);
+}
+
+static inline void mcs_lock(mcs_lock_t* lock, mcs_node_t* me) {
+  if(mcs_enqueue(lock, me))
+    while(!atomic_load(&me->is_free)) { asm_pause(); }
+}
+
+static inline void mcs_unlock(mcs_lock_t* lock, mcs_node_t* me) {
+  if(mcs_release(lock, me))
+    return;
+  while(!atomic_load(&me->next)) { asm_pause(); }
+  atomic_store(&atomic_load(&me->next)->is_free, true);
+}
+
+/*
+ *    CLH lock: a waiter spins on the node of its predecessor. On unlock, the
+ *    caller gives its node to its successor and takes the node of its
+ *    predecessor instead, so clh_unlock updates the caller's node pointer.
+ *    A node can be used with any CLH lock, but only for one held lock at a time.
+ *    The lock owns one node (allocated by clh_init, freed by clh_destroy) and
+ *    each caller owns the node its pointer designates at the end.
+ */
+typedef struct clh_node {
+  bool _Atomic locked;
+  struct clh_node* pred;
+} __attribute__((aligned(QNODE_ALIGN))) clh_node_t;
+
+typedef struct {
+  clh_node_t* _Atomic tail;
+} clh_lock_t;
+
+extern void clh_init(clh_lock_t* lock);
+extern void clh_destroy(clh_lock_t* lock);
+extern clh_node_t* clh_node_alloc();
+
+static inline void clh_lock(clh_lock_t* lock, clh_node_t* me) {
+  atomic_store_explicit(&me->locked, true, memory_order_relaxed);
+  me->pred = atomic_exchange(&lock->tail, me);
+  while(atomic_load(&me->pred->locked)) { asm_pause(); }
+}
+
+static inline void clh_unlock(clh_lock_t* lock, clh_node_t** me) {
+  clh_node_t* pred = (*me)->pred;
+  atomic_store(&(*me)->locked, false);
+  *me = pred; /* nobody spins on it anymore */
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "rcu.h"
+
+#define SPIN_TRIES        1000    /* on a reader before yielding */
+#define WORKER_PERIOD_US  1000    /* the worker looks for callbacks every ms */
+
+uint64_t _Atomic rcu_gp_ctr = 1;
+_Thread_local rcu_reader_t* rcu_me = NULL;
+
+static rcu_reader_t readers[RCU_MAX_THREADS];
+static pthread_mutex_t gp_lock = PTHREAD_MUTEX_INITIALIZER; /* one grace period at a time */
+
+static pthread_key_t exit_key;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+
+static struct rcu_head* _Atomic pending = NULL;   /* newest first */
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+
+static void unregister_at_exit(void* reader) {
+  rcu_unregister_thread();
+}
+
+static void init_exit_key() {
+  pthread_key_create(&exit_key, unregister_at_exit);
+}
+
+void rcu_register_thread() {
+  pthread_once(&exit_once, init_exit_key);
+
+  /* under gp_lock: a running synchronize_rcu sees the thread or not at all */
+  pthread_mutex_lock(&gp_lock);
+  for(int i=0; i<RCU_MAX_THREADS; i++) {
+    bool expected = false;
+    if(atomic_compare_exchange_strong(&readers[i].used, &expected, true)) {
+      rcu_me = &readers[i];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&gp_lock);
+
+  if(!rcu_me) {
+    fprintf(stderr, "rcu: too many threads (max %d)\n", RCU_MAX_THREADS);
+    exit(1);
+  }
+  rcu_thread_online();
+  pthread_setspecific(exit_key, rcu_me);
+}
+
+void rcu_unregister_thread() {
+  if(!rcu_me)
+    return;
+  rcu_thread_offline();
+  atomic_store(&rcu_me->used, false);
+  rcu_me = NULL;
+  pthread_setspecific(exit_key, NULL);
+}
+
+void rcu_thread_offline() {
+  atomic_thread_fence(memory_order_release);
+  atomic_store(&rcu_me->ctr, 0);
+}
+
+void rcu_thread_online() {
+  atomic_store(&rcu_me->ctr, atomic_load(&rcu_gp_ctr));
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+/* the reader is offline or has seen the grace period target */
+static void wait_reader(rcu_reader_t* reader, uint64_t target) {
+  for(int i=0; ; i++) {
+    uint64_t ctr = atomic_load(&reader->ctr);
+    if(!ctr || ctr >= target || !atomic_load(&reader->used))
+      return;
+    if(i < SPIN_TRIES)
+      asm volatile("pause");
+    else
+      sched_yield();
+  }
+}
+
+void synchronize_rcu() {
+  bool online = rcu_me && atomic_load(&rcu_me->ctr);
+
+  if(online)
+    rcu_thread_offline();
+
+  pthread_mutex_lock(&gp_lock);
+  atomic_thread_fence(memory_order_seq_cst);
+  uint64_t target = atomic_fetch_add(&rcu_gp_ctr, 1) + 1;
+  for(int i=0; i<RCU_MAX_THREADS; i++)
+    if(atomic_load(&readers[i].used))
+      wait_reader(&readers[i], target);
+  atomic_thread_fence(memory_order_seq_cst);
+  pthread_mutex_unlock(&gp_lock);
+
+  if(online)
+    rcu_thread_online();
+}
+
+/*
+ * Takes all the pending callbacks at once, one grace period for the batch,
+ * and runs them in the order of call_rcu
+ */
+static void* worker(void* arg) {
+  for(;;) {
+    struct rcu_head* head = atomic_exchange_explicit(&pending, NULL, memory_order_acquire);
+    if(!head) {
+      usleep(WORKER_PERIOD_US);
+      continue;
+    }
+
+    struct rcu_head* fifo = NULL;
+    while(head) {
+      struct rcu_head* next = head->next;
+      head->next = fifo;
+      fifo = head;
+      head = next;
+    }
+
+    synchronize_rcu();
+
+    while(fifo) {
+      struct rcu_head* next = fifo->next;
+      fifo->func(fifo);
+      fifo = next;
+    }
+  }
+  return NULL;
+}
+
+static void start_worker() {
+  pthread_t tid;
+  pthread_create(&tid, NULL, worker, NULL);
+  pthread_detach(tid);
+}
+
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head)) {
+  pthread_once(&worker_once, start_worker);
+
+  head->func = func;
+  struct rcu_head* first = atomic_load_explicit(&pending, memory_order_relaxed);
+  do {
+    head->next = first;
+  } while(!atomic_compare_exchange_weak_explicit(&pending, &first, head,
+                                                 memory_order_release, memory_order_relaxed));
+}
+
+struct barrier {
+  struct rcu_head head;
+  int _Atomic done;
+};
+
+static void barrier_reached(struct rcu_head* head) {
+  atomic_store(&((struct barrier*)head)->done, 1);
+}
+
+/* the callbacks run in order: ours runs after all the ones queued before */
+void rcu_barrier() {
+  struct barrier barrier = { .done = 0 };
+  bool online = rcu_me && atomic_load(&rcu_me->ctr);
+
+  if(online)
+    rcu_thread_offline();
+  call_rcu(&barrier.head, barrier_reached);
+  while(!atomic_load(&barrier.done))
+    usleep(WORKER_PERIOD_US / 10);
+  if(online)
+    rcu_thread_online();
+}
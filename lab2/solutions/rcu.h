@@ -0,0 +1,75 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define RCU_ALIGN       64
+#define RCU_MAX_THREADS 256
+
+/*
+ *    Userspace RCU, quiescent-state based: rcu_read_lock and rcu_read_unlock
+ *    generate no instruction at all, a reader instead announces from time to
+ *    time, outside of any read-side section, that it holds no reference
+ *    anymore (rcu_quiescent_state). A grace period starts by incrementing
+ *    rcu_gp_ctr and ends when every registered thread has announced the new
+ *    value or is offline.
+ *
+ *    - the threads that read call rcu_register_thread first (a thread that
+ *      exits is unregistered automatically), and go offline around anything
+ *      that can block for long
+ *    - synchronize_rcu waits for a grace period, call_rcu defers a callback
+ *      after one: a worker thread runs them by batches, one grace period per
+ *      batch. rcu_barrier waits until the callbacks already queued have run
+ *    - a registered thread that calls synchronize_rcu or rcu_barrier is put
+ *      offline while it waits, so it must not be in a read-side section
+ */
+struct rcu_head {
+  struct rcu_head* next;
+  void (*func)(struct rcu_head* head);
+};
+
+typedef struct {
+  uint64_t _Atomic ctr;           /* last grace period seen, 0 when offline */
+  bool _Atomic used;
+} __attribute__((aligned(RCU_ALIGN))) rcu_reader_t;
+
+extern uint64_t _Atomic rcu_gp_ctr;
+extern _Thread_local rcu_reader_t* rcu_me;
+
+extern void rcu_register_thread();
+extern void rcu_unregister_thread();
+extern void rcu_thread_offline();
+extern void rcu_thread_online();
+
+extern void synchronize_rcu();
+extern void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+extern void rcu_barrier();
+
+#define rcu_dereference(p)       atomic_load_explicit(&(p), memory_order_acquire)
+#define rcu_assign_pointer(p, v) atomic_store_explicit(&(p), (v), memory_order_release)
+
+/* only stop the compiler from moving the accesses out of the section */
+static inline void rcu_read_lock() {
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+static inline void rcu_read_unlock() {
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+/*
+ * The reads of the previous sections are done before the announce, and the
+ * next ones cannot start before it is visible: a full fence, amortized over
+ * the sections between two calls
+ */
+static inline void rcu_quiescent_state() {
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&rcu_me->ctr, atomic_load_explicit(&rcu_gp_ctr, memory_order_relaxed),
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+#endif
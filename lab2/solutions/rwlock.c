@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include "rwlock.h"
+
+#define SPIN_TRIES 128
+#define asm_pause() asm volatile("pause")
+
+void rw_init(rw_lock_t* lock, bool prefer_writers) {
+  atomic_init(&lock->state, 0);
+  atomic_init(&lock->writers, 0);
+  atomic_init(&lock->seq, 0);
+  atomic_init(&lock->nb_waiters, 0);
+  lock->prefer_writers = prefer_writers;
+}
+
+void rw_wake(rw_lock_t* lock) {
+  atomic_fetch_add(&lock->seq, 1);
+  futex_wake(&lock->seq, INT_MAX);
+}
+
+static bool read_blocked(rw_lock_t* lock) {
+  return (atomic_load(&lock->state) & RW_WRITER) ||
+    (lock->prefer_writers && atomic_load(&lock->writers));
+}
+
+static bool write_blocked(rw_lock_t* lock) {
+  return atomic_load(&lock->state) != 0;
+}
+
+/* sleep until a release, unless blocked() is already false: a releaser
+   changes the state before reading nb_waiters, we do the opposite */
+static void wait_release(rw_lock_t* lock, bool (*blocked)(rw_lock_t*)) {
+  uint32_t seq = atomic_load(&lock->seq);
+
+  atomic_fetch_add(&lock->nb_waiters, 1);
+  if(blocked(lock))
+    futex_wait(&lock->seq, seq);
+  atomic_fetch_sub(&lock->nb_waiters, 1);
+}
+
+void rw_read_lock_slow(rw_lock_t* lock) {
+  for(int i=0;; i++) {
+    if(!read_blocked(lock)) {
+      uint32_t s = atomic_load(&lock->state);
+      if(!(s & RW_WRITER) && atomic_compare_exchange_strong(&lock->state, &s, s + 1))
+        return;
+    } else if(i < SPIN_TRIES)
+      asm_pause();
+    else
+      wait_release(lock, read_blocked);
+  }
+}
+
+void rw_write_lock_slow(rw_lock_t* lock) {
+  for(int i=0;; i++) {
+    uint32_t expected = 0;
+    if(atomic_compare_exchange_strong(&lock->state, &expected, RW_WRITER))
+      return;
+    if(i < SPIN_TRIES)
+      asm_pause();
+    else
+      wait_release(lock, write_blocked);
+  }
+}
+
+void br_init(br_lock_t* lock) {
+  atomic_init(&lock->writer, 0);
+  atomic_init(&lock->seq, 0);
+  atomic_init(&lock->nb_waiters, 0);
+  atomic_init(&lock->wlock.state, FREE);
+  lock->nb_slots = sysconf(_SC_NPROCESSORS_CONF);
+  if(lock->nb_slots < 1)
+    lock->nb_slots = 1;
+  lock->slots = aligned_alloc(RW_ALIGN, lock->nb_slots * sizeof(br_slot_t));
+  for(int i=0; i<lock->nb_slots; i++)
+    atomic_init(&lock->slots[i].readers, 0);
+}
+
+void br_destroy(br_lock_t* lock) {
+  free(lock->slots);
+}
+
+int br_read_lock(br_lock_t* lock) {
+  int cpu = sched_getcpu();
+  int slot = cpu < 0 ? 0 : cpu % lock->nb_slots; /* a migration only costs a shared line */
+
+  for(int i=0;; i++) {
+    /* announce ourself, then check for a writer: the writer does the opposite */
+    atomic_fetch_add(&lock->slots[slot].readers, 1);
+    if(!atomic_load(&lock->writer))
+      return slot;
+    atomic_fetch_sub(&lock->slots[slot].readers, 1);
+
+    while(atomic_load(&lock->writer)) {
+      if(i++ < SPIN_TRIES) {
+        asm_pause();
+        continue;
+      }
+      uint32_t seq = atomic_load(&lock->seq);
+      atomic_fetch_add(&lock->nb_waiters, 1);
+      if(atomic_load(&lock->writer))
+        futex_wait(&lock->seq, seq);
+      atomic_fetch_sub(&lock->nb_waiters, 1);
+    }
+  }
+}
+
+void br_read_unlock(br_lock_t* lock, int slot) {
+  atomic_fetch_sub(&lock->slots[slot].readers, 1);
+}
+
+void br_write_lock(br_lock_t* lock) {
+  futex_lock(&lock->wlock);
+  atomic_store(&lock->writer, 1);
+
+  /* the readers are short: spin, and yield to a preempted reader */
+  for(int s=0; s<lock->nb_slots; s++)
+    for(int i=0; atomic_load(&lock->slots[s].readers); i++) {
+      if(i < SPIN_TRIES)
+        asm_pause();
+      else
+        sched_yield();
+    }
+}
+
+void br_write_unlock(br_lock_t* lock) {
+  atomic_store(&lock->writer, 0);
+  if(atomic_load(&lock->nb_waiters)) {
+    atomic_fetch_add(&lock->seq, 1);
+    futex_wake(&lock->seq, INT_MAX);
+  }
+  futex_unlock(&lock->wlock);
+}
\ No newline at end of file
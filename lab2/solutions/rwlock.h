@@ -0,0 +1,90 @@
+#ifndef _RW_LOCK_H_
+#define _RW_LOCK_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "futexlock.h"
+
+#define RW_ALIGN 64
+#define RW_WRITER 0x80000000u  /* state bit of the writer, the other bits count the readers */
+
+/*
+ *    Futex reader-writer lock. Waiters spin a little, then sleep on seq,
+ *    which a release increments only if someone sleeps.
+ *    With prefer_writers, a reader does not enter while a writer is waiting,
+ *    otherwise a writer waits until no reader holds the lock (readers can
+ *    starve writers).
+ */
+typedef struct {
+  uint32_t _Atomic state;
+  uint32_t _Atomic writers;     /* waiting or active writers, only with prefer_writers */
+  uint32_t _Atomic seq;
+  uint32_t _Atomic nb_waiters;
+  bool prefer_writers;
+} __attribute__((aligned(RW_ALIGN))) rw_lock_t;
+
+extern void rw_init(rw_lock_t* lock, bool prefer_writers);
+extern void rw_read_lock_slow(rw_lock_t* lock);
+extern void rw_write_lock_slow(rw_lock_t* lock);
+extern void rw_wake(rw_lock_t* lock);
+
+static inline void rw_read_lock(rw_lock_t* lock) {
+  uint32_t s = atomic_load_explicit(&lock->state, memory_order_relaxed);
+
+  if((s & RW_WRITER) || (lock->prefer_writers && atomic_load(&lock->writers)) ||
+     !atomic_compare_exchange_strong(&lock->state, &s, s + 1))
+    rw_read_lock_slow(lock);
+}
+
+static inline void rw_read_unlock(rw_lock_t* lock) {
+  /* only writers wait for the readers to leave */
+  if(atomic_fetch_sub(&lock->state, 1) == 1 && atomic_load(&lock->nb_waiters))
+    rw_wake(lock);
+}
+
+static inline void rw_write_lock(rw_lock_t* lock) {
+  uint32_t expected = 0;
+
+  if(lock->prefer_writers)
+    atomic_fetch_add(&lock->writers, 1);
+  if(!atomic_compare_exchange_strong(&lock->state, &expected, RW_WRITER))
+    rw_write_lock_slow(lock);
+}
+
+static inline void rw_write_unlock(rw_lock_t* lock) {
+  if(lock->prefer_writers)
+    atomic_fetch_sub(&lock->writers, 1);
+  atomic_store(&lock->state, 0);
+  if(atomic_load(&lock->nb_waiters))
+    rw_wake(lock);
+}
+
+/*
+ *    Big-reader lock: one reader counter per CPU, each on its own cache line,
+ *    so that readers on different CPUs never write the same line. A writer
+ *    excludes the other writers with a futex lock, raises its flag, then waits
+ *    for every counter to drop to zero: writes are expensive, reads are not.
+ *    br_read_lock returns the slot that br_read_unlock must release.
+ */
+typedef struct {
+  uint32_t _Atomic readers;
+} __attribute__((aligned(RW_ALIGN))) br_slot_t;
+
+typedef struct {
+  uint32_t _Atomic writer __attribute__((aligned(RW_ALIGN)));
+  uint32_t _Atomic seq;
+  uint32_t _Atomic nb_waiters;
+  futex_lock_t wlock;
+  int nb_slots;
+  br_slot_t* slots;
+} br_lock_t;
+
+extern void br_init(br_lock_t* lock);
+extern void br_destroy(br_lock_t* lock);
+extern int br_read_lock(br_lock_t* lock);
+extern void br_read_unlock(br_lock_t* lock, int slot);
+extern void br_write_lock(br_lock_t* lock);
+extern void br_write_unlock(br_lock_t* lock);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef _TSC_H_
+#define _TSC_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <cpuid.h>
+
+/*
+ *    TSC timing: reading the time stamp counter costs a few ns, against
+ *    20-40 ns for clock_gettime, and a delay loop compares integers. The
+ *    counter must be invariant (same rate in all the P/C-states and on all
+ *    the cores), tsc_init checks it and measures its rate once against
+ *    CLOCK_MONOTONIC. Convert the delays to cycles with tsc_from_ns before
+ *    the loops, not inside.
+ *
+ *    Header only so that a single-file program can use it: tsc_init must be
+ *    called by each program that includes it, before any conversion.
+ */
+#define TSC_CALIBRATION_NS 50000000 /* 50ms */
+
+static double tsc_cycles_per_ns = 0;
+
+static inline uint64_t tsc_now() {
+  return __builtin_ia32_rdtsc();
+}
+
+static inline uint64_t tsc_from_ns(uint64_t ns) {
+  return ns * tsc_cycles_per_ns;
+}
+
+static inline double tsc_to_ns(uint64_t cycles) {
+  return cycles / tsc_cycles_per_ns;
+}
+
+/* busy wait until the counter reaches deadline, returns the last reading */
+static inline uint64_t tsc_delay_until(uint64_t deadline) {
+  uint64_t now;
+
+  while((now = tsc_now()) < deadline)
+    asm volatile("pause");
+  return now;
+}
+
+static inline uint64_t tsc_clock_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static void tsc_init() {
+  unsigned int eax, ebx, ecx, edx;
+
+  if(tsc_cycles_per_ns)
+    return;
+
+  /* CPUID.80000007H:EDX[8] is the invariant TSC bit */
+  if(!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+    fprintf(stderr, "warning: the TSC is not invariant, the delays are not reliable\n");
+
+  uint64_t ns0 = tsc_clock_ns(), c0 = tsc_now();
+  uint64_t ns1, c1;
+  do {
+    ns1 = tsc_clock_ns();
+    c1 = tsc_now();
+  } while(ns1 - ns0 < TSC_CALIBRATION_NS);
+
+  tsc_cycles_per_ns = (double)(c1 - c0) / (ns1 - ns0);
+}
+
+#endif
\ No newline at end of file